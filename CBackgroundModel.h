@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CBACKGROUNDMODEL_H
+#define CBACKGROUNDMODEL_H
+
+#include <QtCore/QVector>
+#include <QtCore/QtGlobal>
+#include <cmath>
+
+#include "CScan.h"
+
+// Per-beam range statistics for change detection. Each beam (angle bucket)
+// keeps an exponentially weighted mean and variance in flat arrays; a return
+// that is more than sigmaK deviations (and minDelta) away from its mean is
+// flagged as changed. Changed beams adapt with slowAlpha so a parked object
+// is eventually absorbed into the background.
+class CBackgroundModel {
+public:
+    struct Options {
+        int   beams = 1200;         // angle buckets over 360 deg
+        float alpha = 0.05f;        // learning rate of matching returns
+        float slowAlpha = 0.002f;   // learning rate of changed returns
+        float sigmaK = 3.0f;
+        float minDelta = 50.0f;     // mm, floor on the change threshold
+        int   warmup = 20;          // scans averaged before flagging starts
+    };
+
+    CBackgroundModel() { reset(); }
+
+    void setOptions(const Options &options)
+    {
+        m_options = options;
+        reset();
+    }
+    const Options &options() const { return m_options; }
+
+    // Buckets to match the sensor's beams per revolution; a change starts
+    // learning afresh, since the old buckets cover other angles.
+    void setBeams(int beams)
+    {
+        if (beams == m_options.beams)
+            return;
+        m_options.beams = beams;
+        reset();
+    }
+
+    void reset()
+    {
+        const int beams = qMax(1, m_options.beams);
+        m_mean.fill(0.0f, beams);
+        m_var.fill(0.0f, beams);
+        m_seen.fill(0, beams);
+        m_changed = 0;
+    }
+
+    // Dropouts (range <= 0) are skipped. Fills mask() per beam of the scan
+    // and returns the number of changes.
+    int update(const CScan &scan)
+    {
+        const int count = scan.size();
+        const float *angle = scan.angle();
+        const float *range = scan.range();
+        if (m_mask.size() < count)
+            m_mask.resize(count);
+        const int beams = m_mean.size();
+        const float perDegree = beams / 360.0f;
+        const int warmup = m_options.warmup;
+        const float k2 = m_options.sigmaK * m_options.sigmaK;
+        const float minDelta2 = m_options.minDelta * m_options.minDelta;
+        float *mean = m_mean.data();
+        float *var = m_var.data();
+        quint16 *seen = m_seen.data();
+        quint8 *mask = m_mask.data();
+
+        m_changed = 0;
+        for (int i = 0; i < count; i++) {
+            const float r = range[i];
+            mask[i] = 0;
+            if (r <= 0.0f)
+                continue;
+            int b = int(angle[i] * perDegree + 0.5f) % beams;
+            if (b < 0)
+                b += beams;
+
+            const float diff = r - mean[b];
+            float a;
+            if (seen[b] < warmup) {
+                a = 1.0f / ++seen[b];
+            }
+            else if (diff * diff > qMax(k2 * var[b], minDelta2)) {
+                mask[i] = 1;
+                m_changed++;
+                a = m_options.slowAlpha;
+            }
+            else {
+                a = m_options.alpha;
+            }
+            mean[b] += a * diff;
+            var[b] = (1.0f - a) * (var[b] + a * diff * diff);
+        }
+        return m_changed;
+    }
+
+    const quint8 *mask() const { return m_mask.constData(); }
+    int changed() const { return m_changed; }
+    int beams() const { return m_mean.size(); }
+
+private:
+    Options m_options;
+    QVector<float> m_mean;
+    QVector<float> m_var;
+    QVector<quint16> m_seen;
+    QVector<quint8> m_mask;
+    int m_changed = 0;
+};
+
+#endif // CBACKGROUNDMODEL_H
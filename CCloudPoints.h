@@ -27,76 +27,87 @@
 #include <QPointF>
 #include <QtMath>
 
+#include "CScan.h"
+#include "CTrace.h"
+
+// Keeps the valid returns of the last two revolutions as angle/range
+// floats in a ring, oldest overwritten first. View points are built from
+// them into the caller's buffer when the view asks for them.
 class CCloudPoints : public QObject {
     Q_OBJECT
 
 public:
     CCloudPoints(QObject *parent = nullptr)
         : QObject(parent), m_resolution(0.3f), m_measureCnt(360 / m_resolution),
-        m_maxPoints(m_measureCnt), m_pixelsPerMeter(100), m_scale(m_pixelsPerMeter / 1000)
+        m_pixelsPerMeter(100)
     {
+        setLayout(m_measureCnt, m_resolution);
         // connect(&timer, &QTimer::timeout, this, &CCloudPoints::generateVirtualData);
         // timer.start(1000 / 10); // rps
     }
 
-    QVector<QPointF> getPoints() const {
-        return m_points;
-    }
-
-    QVector<QPointF> setPoints(QVector<QPointF> points) {
-        m_points.append(points);
-        int excess = m_points.size() - m_maxPoints;
-        if (excess > 0) {
-            for (int i = 0; i < excess; i++) {
-                m_points.removeFirst();
-            }
+    // Kept returns in view pixels, oldest first.
+    void getPoints(QVector<QPointF> &points) const {
+        LUMO_TRACE("CCloudPoints::getPoints");
+        points.resize(m_count);
+        const int first = (m_head - m_count + m_maxPoints) % m_maxPoints;
+        for (int i = 0; i < m_count; i++) {
+            const int k = (first + i) % m_maxPoints;
+            const float radian = qDegreesToRadians(m_angle[k]);
+            const float pixels = m_range[k] * m_scale;
+            points[i] = QPointF(pixels * std::cos(radian), pixels * std::sin(radian));
         }
     }
 
-    void setPoint(float angle, float distance) {
-        float radian = angle * M_PI / 180.0;
-
-        distance *= m_scale;
-        float x = distance * std::cos(radian);
-        float y = distance * std::sin(radian);
-        m_points.append(QPointF(x, y));
-
-        int excess = m_points.size() - m_maxPoints;
-        if (excess > 0) {
-            for (int i = 0; i < excess; i++) {
-                m_points.removeFirst();
-            }
+    void setScan(const CScan &scan) {
+        LUMO_TRACE("CCloudPoints::setScan");
+        const float *angle = scan.angle();
+        const float *range = scan.range();
+        for (int i = 0; i < scan.size(); i++) {
+            if (range[i] > 0.0f)
+                setPoint(angle[i], range[i]);
         }
     }
 
     int getPointCount() const {
-        return m_points.size();
+        return m_count;
     }
 
     void clearPoints() {
-        m_points.clear();
+        m_head = m_count = 0;
+    }
+
+    // Beam count and spacing of the connected sensor model; drops the kept
+    // returns.
+    void setLayout(int beams, float resolution) {
+        m_measureCnt = beams;
+        m_resolution = resolution;
+        m_maxPoints = qMax(1, m_measureCnt * 2);
+        m_angle.resize(m_maxPoints);
+        m_range.resize(m_maxPoints);
+        clearPoints();
+    }
+
+    // Memory of the kept returns.
+    size_t bytes() const {
+        return size_t(m_angle.capacity() + m_range.capacity()) * sizeof(float);
     }
 
 public slots:
     void generateVirtualData() {
         static int shapeType = 0;
-        if (m_points.size() >= m_maxPoints)
-            m_points.clear();
+        if (m_count >= m_maxPoints)
+            clearPoints();
         // 가상 데이터 생성
         float angle = 270;
-        for (int i = 0; i < m_measureCnt; ++i) { // 0.3도 간격으로 360도 커버
-            angle += 0.3;
+        for (int i = 0; i < m_measureCnt; ++i) { // 분해능 간격으로 360도 커버
+            angle += m_resolution;
             if (angle < 0)
                 angle += 360;
             if (angle > 360)
                 angle -= 360;
 
-            float radian = angle * M_PI / 180.0;
-            float distance = (shapeType) ? 3000 : 2500 + (i % 50); // 사각형 및 원 모양 교차
-            distance *= m_scale;
-            float x = distance * std::cos(radian);
-            float y = distance * std::sin(radian);
-            m_points.append(QPointF(x, y));
+            setPoint(angle, (shapeType) ? 3000 : 2500 + (i % 50)); // 사각형 및 원 모양 교차
         }
         ++shapeType %= 2;
         emit newData();
@@ -106,15 +117,26 @@ signals:
     void newData();
 
 private:
-    QVector<QPointF> m_points;
+    QVector<float> m_angle;     // deg
+    QVector<float> m_range;     // mm
+    int m_head = 0;             // next slot written
+    int m_count = 0;
     QTimer timer;
 
     float m_resolution = 0.3;
     int m_measureCnt = 360 / m_resolution;
-    const int m_maxPoints = m_measureCnt * 2;
+    int m_maxPoints = m_measureCnt * 2;
 
     float m_pixelsPerMeter = 100;
     float m_scale = m_pixelsPerMeter / 1000;
+
+    void setPoint(float angle, float distance) {
+        m_angle[m_head] = angle;
+        m_range[m_head] = distance;
+        m_head = (m_head + 1) % m_maxPoints;
+        if (m_count < m_maxPoints)
+            m_count++;
+    }
 };
 
 
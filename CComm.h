@@ -20,17 +20,19 @@
 #ifndef COMM_H
 #define COMM_H
 
-#include <QtCore/QFuture>
-#include <QFutureWatcher>
 #include <QtCore/QTimer>
 #include <QtCore/QObject>
+#include <QtCore/QIODevice>
 
 #include <QtCore/QMutex>
-#include <QtConcurrent>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRandomGenerator>
 
+#include <atomic>
+
+#include "CClock.h"
+#include "CTrace.h"
 
-#define THREAD_BEGIN    QtConcurrent::run([&]() {
-#define THREAD_END      });
 
 #ifndef _WINBASE_
 #define IGNORE              0       // Ignore signal
@@ -63,22 +65,30 @@ class Comm : public QObject {
 
 public:
     Comm(QObject *parent = nullptr, int commID = 0)
-        : QObject(parent), connWatchdog(this), progTimeout(this)
+        : QObject(parent), connWatchdog(this), progTimeout(this), connDeadline(this)
     {
         m_commID = commID;
         m_status = eStatus::closed;
         //m_statErr = eStatus::noErrStat;
+        m_clock.start();
 
         QObject::connect(&connWatchdog, &QTimer::timeout, this, [&]() {
             if (!this->m_isClosed) {
-                checkConn(false);
+                watchConn();
+            }
+        });
+
+        connDeadline.setSingleShot(true);
+        QObject::connect(&connDeadline, &QTimer::timeout, this, [&]() {
+            if (m_status == eStatus::connecting && !checkConnProc()) {
+                closeProc(0);
+                connFailed();
             }
         });
 
         progTimeout.setSingleShot(true);
         QObject::connect(&progTimeout, &QTimer::timeout, this, [&]() {
-            if (worker.isRunning()) {
-                worker.cancel();
+            if (m_asyncPending) {
                 if (m_status == eStatus::sending) {
                     setStatus(eStatus::sendFailed);
                 }
@@ -90,44 +100,70 @@ public:
                 }
                 else if (m_status == eStatus::ready) {
                     emit onProgress(this, eProgress::inbox, m_bytesInbox);
-                    QCoreApplication::processEvents();
                 }
             }
         });
-
-        futureTimer.setSingleShot(true);
-        QObject::connect(&futureTimer, &QTimer::timeout, this, [&]() {
-            future.cancel();
-        });
     }
     virtual ~Comm() override {
         m_isClosed = true;
         m_status = eStatus::closed;
         connWatchdog.stop();
         progTimeout.stop();
-        futureMtx.~QMutex();
+        connDeadline.stop();
     }
 private:
-    QFuture<bool> future;
-    QTimer futureTimer;
-    QMutex futureMtx;
+    // Connection attempts never block: connectProc(0) only starts the
+    // attempt, completion is picked up by checkConn()/watchConn() and an
+    // attempt that is still pending after the connect timeout is aborted.
+    bool tryConnect() {
+        setStatus(eStatus::connecting);
+        m_isConnected = connectProc(0);
+        if (m_isConnected) {
+            connDeadline.stop();
+            m_retryDelay = 0;
+            setStatus(eStatus::connected);
+            return true;
+        }
+        if (!pendingConnProc()) {
+            connFailed();
+            return false;
+        }
+        if (m_enableConnTimeout && m_connTimeout && m_connTimeout < INFINITE)
+            connDeadline.start(m_connTimeout);
+        return true;
+    }
 
-    bool runINTime(bool enableTimeout, quint32 timeout, std::function<bool()> func) {
-        QMutexLocker locker(&futureMtx);
+    void connFailed() {
+        connDeadline.stop();
+        m_isConnected = false;
+        setStatus(eStatus::connFailed);
+        scheduleRetry();
+    }
 
-        bool ret = false;
-        if (enableTimeout && timeout && timeout < INFINITE) {
-            future.cancel();
-            future = QtConcurrent::run(func);
-            futureTimer.start(timeout);
-            future.waitForFinished();
-            futureTimer.stop();
-            ret = (!future.isCanceled() && future.result());
-        }
-        else
-            ret = func();
+    // Exponential backoff with equal jitter: the next attempt is made
+    // between delay/2 and delay after the failure.
+    void scheduleRetry() {
+        if (!m_autoReconnect || m_isClosed)
+            return;
+        m_retryDelay = m_retryDelay ? qMin(m_retryDelay * 2, m_maxRetryDelay) : m_minRetryDelay;
+        int half = m_retryDelay / 2;
+        m_nextRetry = m_clock.elapsed() + half + QRandomGenerator::global()->bounded(half + 1);
+    }
 
-        return ret;
+    void watchConn() {
+        if (m_status == eStatus::connecting) {
+            if (checkConnProc())
+                checkConn(false);
+            else if (!pendingConnProc())
+                connFailed();
+            return;
+        }
+        checkConn(false);
+        if (!m_isConnected && m_retryDelay && m_clock.elapsed() >= m_nextRetry) {
+            if (checkConnProc() || pendingConnProc())
+                closeProc(0);
+            tryConnect();
+        }
     }
 
 public:
@@ -167,27 +203,31 @@ public:
     }
 
 public:
+    // Starts a connection attempt and returns at once; the outcome is
+    // reported through onStatus. Returns false if the attempt failed
+    // immediately (no connection info, port could not be opened, ...).
     bool connect(quint32 timeout = INFINITE) {
         if (!m_connAvailable)
             return false;
 
         m_isClosed = false;
-
-        setStatus(eStatus::connecting);
-        m_isConnected = this->runINTime(m_enableConnTimeout, timeout, [&]()->bool {
-            return connectProc(timeout);
-        });
-        if (m_isConnected)
-            setStatus(eStatus::connected);
-        else
-            setStatus(eStatus::connFailed);
-        return m_isConnected;
+        m_retryDelay = 0;
+        m_connTimeout = timeout;
+        return tryConnect();
     }
 
     bool close(quint32 timeout = INFINITE) {
         m_isClosed = true;
-        if (!checkConnProc())
+        m_retryDelay = 0;
+        connDeadline.stop();
+        if (!checkConnProc()) {
+            if (pendingConnProc())
+                closeProc(0);
+            if (m_status == eStatus::connecting)
+                setStatus(eStatus::closed);
+            m_isConnected = false;
             return true;
+        }
 
         setStatus(eStatus::closing);
         m_isConnected = !closeProc(timeout);
@@ -201,6 +241,7 @@ public:
 
 private:
     Q_INVOKABLE bool doSendProc(QByteArray &data, quint32 timeout) {
+        LUMO_TRACE("Comm::send");
         QMutexLocker locker(&commMtx);
 
         bool ret = false;
@@ -229,12 +270,12 @@ public:
             return false;
 
         if (async) {
-            worker = QtConcurrent::run([this, &data, timeout]() {
-                QMetaObject::invokeMethod(this, "doSendProc",
-                                          Qt::BlockingQueuedConnection,
-                                          Q_ARG(QByteArray&, data),
-                                          Q_ARG(quint32, timeout));
-            });
+            m_asyncPending = true;
+            QMetaObject::invokeMethod(this, [this, &data, timeout]() {
+                doSendProc(data, timeout);
+                m_asyncPending = false;
+            }, Qt::QueuedConnection);
+            return true;
         }
         else {
             return doSendProc(data, timeout);
@@ -243,6 +284,7 @@ public:
 
 private:
     Q_INVOKABLE bool doInboxProc(quint32 timeout) {
+        LUMO_TRACE("Comm::inbox");
         QMutexLocker locker(&commMtx);
 
         bool ret = false;
@@ -257,7 +299,6 @@ private:
             ret = inboxProc(timeout);
         if (ret) {
             emit onProgress(this, eProgress::inbox, m_bytesInbox);
-            QCoreApplication::processEvents();
         }
         return ret;
     }
@@ -269,11 +310,11 @@ public:
             return false;
 
         if (async) {
-            worker = QtConcurrent::run([this, timeout]() {
-                QMetaObject::invokeMethod(this, "doInboxProc",
-                                          Qt::BlockingQueuedConnection,
-                                          Q_ARG(quint32, timeout));
-            });
+            m_asyncPending = true;
+            QMetaObject::invokeMethod(this, [this, timeout]() {
+                doInboxProc(timeout);
+                m_asyncPending = false;
+            }, Qt::QueuedConnection);
             return true;
         }
         else {
@@ -283,11 +324,14 @@ public:
 
 private:
     Q_INVOKABLE bool doRecvProc(QByteArray &data, quint32 timeout) {
-
+        LUMO_TRACE("Comm::recv");
         QMutexLocker locker(&commMtx);
 
         bool ret = false;
         m_bytesRecv = 0;
+        m_recvStamp = CClock::nsecs();
+        m_lastArrival = m_arrivalStamp ? m_arrivalStamp : m_recvStamp;
+        m_arrivalStamp = 0;
 
         setStatus(eStatus::recving);
         if (m_enableRecvTimeout && timeout && timeout < INFINITE) {
@@ -312,12 +356,11 @@ public:
             return false;
 
         if (async) {
-            worker = QtConcurrent::run([this, &buffer, timeout]() {
-                QMetaObject::invokeMethod(this, "doRecvProc",
-                                          Qt::BlockingQueuedConnection,
-                                          Q_ARG(QByteArray&, buffer),
-                                          Q_ARG(quint32, timeout));
-            });
+            m_asyncPending = true;
+            QMetaObject::invokeMethod(this, [this, &buffer, timeout]() {
+                doRecvProc(buffer, timeout);
+                m_asyncPending = false;
+            }, Qt::QueuedConnection);
             return true;
         }
         else {
@@ -329,6 +372,17 @@ public:
         return m_bytesRecv;
     }
 
+    // CClock time at which the last recv() started pulling data.
+    qint64 recvStamp() const {
+        return m_recvStamp;
+    }
+
+    // CClock time at which the data of the last recv() first became
+    // readable, as seen by the event loop; recvStamp() if not known.
+    qint64 arrivalStamp() const {
+        return m_lastArrival;
+    }
+
     int bytesSent() const {
         return m_bytesSent;
     }
@@ -347,6 +401,8 @@ public:
         if (this->checkConnProc()) {
             if (!m_isConnected) {
                 m_isConnected = true;
+                connDeadline.stop();
+                m_retryDelay = 0;
                 setStatus(eStatus::connected);
             }
         }
@@ -354,17 +410,37 @@ public:
             if (m_isConnected) {
                 m_isConnected = false;
                 setStatus(eStatus::connLost);
+                scheduleRetry();
             }
         }
         return m_isConnected;
     }
 
     bool reconnect() {
-        if (checkConnProc())
-            closeProc();
-        connectProc();
-        //commMtx.unlock();
-        return checkConn();
+        if (!m_connAvailable)
+            return false;
+
+        m_isClosed = false;
+        connDeadline.stop();
+        if (checkConnProc() || pendingConnProc())
+            closeProc(0);
+        m_isConnected = false;
+        m_retryDelay = 0;
+        return tryConnect();
+    }
+
+    // Retries after connFailed/connLost from the connection watchdog, waiting
+    // minDelay, 2*minDelay, ... up to maxDelay (ms) between attempts.
+    void setReconnect(bool enable, int minDelay = 500, int maxDelay = 30000) {
+        m_autoReconnect = enable;
+        m_minRetryDelay = qMax(1, minDelay);
+        m_maxRetryDelay = qMax(m_minRetryDelay, maxDelay);
+        if (!enable)
+            m_retryDelay = 0;
+    }
+
+    bool isReconnecting() const {
+        return m_autoReconnect && !m_isClosed;
     }
 
     bool isConnected() const {
@@ -417,43 +493,105 @@ protected:
     virtual bool inboxProc(quint32 timeout = IGNORE) = 0;
     virtual bool recvProc(QByteArray &buffer, quint32 timeout = INFINITE) = 0;
     virtual bool checkConnProc(bool emergency = false) const = 0;
+    //Optional: true while an asynchronous connection attempt is in flight.
+    virtual bool pendingConnProc() const { return false; }
 
 private:
+    // Transitions are single atomic stores; completion states (connected,
+    // sent, recved) settle to ready with a compare-exchange so a newer state
+    // set meanwhile is never overwritten.
     void setStatus(eStatus status) {
-        if (m_status == status) return;
+        eStatus prev = m_status.exchange(status);
+        if (prev == status) return;
+        postStatus(status);
 
-        m_status = status;
-        emit onStatus(this, status);
-        QCoreApplication::processEvents();
-
-        switch (m_status) {
+        switch (status) {
         case eStatus::connected:
         case eStatus::sent:
-        case eStatus::recved:
-            QtConcurrent::run([&, this]() {
-                m_status = eStatus::ready;
-                QMetaObject::invokeMethod(this, "onStatus",
-                                          Qt::BlockingQueuedConnection,
-                                          Q_ARG(Comm*, this),
-                                          Q_ARG(eStatus, eStatus::ready));
-            });
+        case eStatus::recved: {
+            eStatus done = status;
+            if (m_status.compare_exchange_strong(done, eStatus::ready))
+                postStatus(eStatus::ready);
             break;
+        }
         default:
             break;
         }
     }
 
+    // Notifications are coalesced: at most one queued flush is outstanding.
+    // Event states go into a small ring under eventMtx and are delivered in
+    // the order they happened; a repeat of the newest one is merged with it
+    // and if the ring overflows the oldest are lost. ready/sending/recving
+    // only describe the current state and are delivered as the final,
+    // current status. So is recved: it comes once per packet and readers
+    // poll inbox(), so the receive path never takes the lock.
+    static bool isTransient(eStatus status) {
+        return status == eStatus::ready ||
+               status == eStatus::sending ||
+               status == eStatus::recving ||
+               status == eStatus::recved;
+    }
+
+    void postStatus(eStatus status) {
+        if (!isTransient(status))
+            pushEvent(status);
+        if (!m_notifyQueued.exchange(true))
+            QMetaObject::invokeMethod(this, "flushStatus", Qt::QueuedConnection);
+    }
+
+    void pushEvent(eStatus status) {
+        QMutexLocker locker(&eventMtx);
+        if (m_eventCount && m_events[(m_eventHead + m_eventCount - 1) % eventCapacity] == status)
+            return;
+        if (m_eventCount == eventCapacity) {
+            m_eventHead = (m_eventHead + 1) % eventCapacity;
+            m_eventCount--;
+        }
+        m_events[(m_eventHead + m_eventCount) % eventCapacity] = status;
+        m_eventCount++;
+    }
+
+    Q_INVOKABLE void flushStatus() {
+        m_notifyQueued = false;
+        eStatus events[eventCapacity];
+        int count;
+        {
+            QMutexLocker locker(&eventMtx);
+            count = m_eventCount;
+            for (int i = 0; i < count; i++)
+                events[i] = m_events[(m_eventHead + i) % eventCapacity];
+            m_eventHead = m_eventCount = 0;
+        }
+        for (int i = 0; i < count; i++)
+            notifyStatus(events[i]);
+        eStatus current = m_status;
+        if (current != m_notified)
+            notifyStatus(current);
+    }
+
+    void notifyStatus(eStatus status) {
+        m_notified = status;
+        emit onStatus(this, status);
+    }
+
 protected:
     void setProgress(eProgress progress, quint32 bytesTotal) {
         progTimeout.stop();
         emit onProgress(this, progress, bytesTotal);
-        QCoreApplication::processEvents();
         progTimeout.start(m_timeout);
     }
 
     void raiseAlert(int alertCode, const QString msg) {
         emit onAlert(this, alertCode, msg);
-        QCoreApplication::processEvents();
+    }
+
+    // Reads into the caller's buffer, reusing its capacity; readAll() would
+    // allocate a new array on every receive.
+    static void readInto(QIODevice *device, QByteArray &buffer, qint64 bytes) {
+        buffer.resize(int(bytes));
+        qint64 n = bytes > 0 ? device->read(buffer.data(), bytes) : 0;
+        buffer.resize(int(qMax<qint64>(0, n)));
     }
 
     bool isClosed() const {
@@ -472,23 +610,47 @@ protected:
     int m_connNum = 0;
     bool m_connAvailable = false;
 
-    eStatus m_status = eStatus::closed;
+    std::atomic<eStatus> m_status{eStatus::closed};
     //eStatErr m_statErr = eStatus::noErrStat;
     bool m_isClosed = true;
     bool m_isConnected = false;
     int m_bytesSent = 0;
     int m_bytesRecv = 0;
     int m_bytesInbox = 0;
+    qint64 m_recvStamp = 0;
+    qint64 m_arrivalStamp = 0;      // first arrival since the last recv()
+    qint64 m_lastArrival = 0;
+
+    void markArrival() {
+        if (!m_arrivalStamp)
+            m_arrivalStamp = CClock::nsecs();
+    }
 
     QTimer connWatchdog;
     QTimer progTimeout;
-    QFuture<void> worker;
+    bool m_asyncPending = false;    // async send/inbox/recv queued or running
     QMutex commMtx;
 
 private:
     quint32 m_inbox = 0;
     quint32 m_timeout = INFINITE;
     bool m_enableConnTimeout = false, m_enableSendTimeout = false, m_enableRecvTimeout = false;
+
+    QTimer connDeadline;
+    QElapsedTimer m_clock;
+    quint32 m_connTimeout = INFINITE;
+    bool m_autoReconnect = false;
+    int m_minRetryDelay = 500;
+    int m_maxRetryDelay = 30000;
+    int m_retryDelay = 0;       // 0: no retry scheduled
+    qint64 m_nextRetry = 0;
+
+    static const int eventCapacity = 16;
+    QMutex eventMtx;
+    eStatus m_events[eventCapacity];
+    int m_eventHead = 0, m_eventCount = 0;
+    std::atomic<bool> m_notifyQueued{false};
+    eStatus m_notified = eStatus::closed;
 };
 
 #include <QtCore/QByteArray>
@@ -508,6 +670,7 @@ public:
         : Comm(parent, commID), socket(new QTcpSocket(this)) {
         QObject::connect(socket, &QTcpSocket::errorOccurred, this, &TCPComm::handleError);
         QObject::connect(socket, &QTcpSocket::disconnected, this, &TCPComm::handleLostConn);
+        QObject::connect(socket, &QTcpSocket::readyRead, this, &TCPComm::markArrival);
         QObject::connect(socket, &QTcpSocket::stateChanged, this, &TCPComm::handleStateChanged);
     }
     ~TCPComm() { socket->close(); }
@@ -563,7 +726,7 @@ protected:
             socket->waitForReadyRead(timeout);
             recvBytes = socket->bytesAvailable();
         }
-        buffer = socket->readAll();
+        readInto(socket, buffer, recvBytes);
         m_bytesRecv = buffer.size();
         return (bool)m_bytesRecv;
     }
@@ -572,6 +735,12 @@ protected:
         return socket->state() == QAbstractSocket::ConnectedState;
     }
 
+    bool pendingConnProc() const override {
+        QAbstractSocket::SocketState curStat = socket->state();
+        return curStat == QAbstractSocket::HostLookupState ||
+               curStat == QAbstractSocket::ConnectingState;
+    }
+
 private:
     QTcpSocket *socket;
     quint16 m_port;
@@ -588,12 +757,25 @@ private:
     }
 
     void handleStateChanged(QAbstractSocket::SocketState stat) {
-
+        if (stat == QAbstractSocket::ConnectedState && !this->isClosed())
+            checkConn(true);
     }
 };
 
 // UDPComm class
 #include <QtNetwork/QUdpSocket>
+#include <QtNetwork/QNetworkInterface>
+#if defined(Q_OS_UNIX)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+// connString: "a.b.c.d" binds unicast, a multicast group (224.0.0.0/4) joins
+// that group instead, optionally on a given interface: "239.255.0.1@eth0".
+// In multicast mode the port is shared, so any number of viewers and
+// recorders on the same host or network can subscribe to one sensor feed.
 class UDPComm : public Comm {
     Q_OBJECT
 
@@ -603,19 +785,41 @@ public:
         : Comm(parent, commID), socket(new QUdpSocket(this)) {
         QObject::connect(socket, &QUdpSocket::errorOccurred, this, &UDPComm::handleError);
         QObject::connect(socket, &QUdpSocket::disconnected, this, &UDPComm::handleLostConn);
+        QObject::connect(socket, &QUdpSocket::readyRead, this, &UDPComm::markArrival);
+    }
+    ~UDPComm() {
+        if (m_isMulticast && socket->state() == QAbstractSocket::BoundState)
+            leaveGroup();
+        socket->close();
+    }
+
+    bool isMulticast() const {
+        return m_isMulticast;
     }
-    ~UDPComm() { socket->close(); }
 
 protected:
     bool setConnInfoProc(QString connString, int connNum, void* connInfo) override {
         bool isOK = (connNum > 0 && connNum <= 65535);
         if (!isOK)
             return false;
-        if (connString.count('.') != 3)
+
+        QString addr = connString.section('@', 0, 0).trimmed();
+        QString ifName = connString.section('@', 1).trimmed();
+        if (addr.count('.') != 3)
             hostAddr = QHostAddress::AnyIPv4;
         else
-            hostAddr.setAddress(connString);
+            hostAddr.setAddress(addr);
         m_port = (quint16)connNum;
+
+        m_isMulticast = hostAddr.isMulticast();
+        m_iface = QNetworkInterface();
+        if (!ifName.isEmpty()) {
+            if (!m_isMulticast)
+                return false;
+            m_iface = QNetworkInterface::interfaceFromName(ifName);
+            if (!m_iface.isValid())
+                return false;
+        }
         return true;
     }
 
@@ -625,6 +829,9 @@ protected:
         if (checkConnProc())
             return true;
 
+        if (m_isMulticast)
+            return joinGroup();
+
         bool isOK = socket->bind(hostAddr, m_port);
         if (isOK) {
             socket->connectToHost(hostAddr, m_port);
@@ -632,11 +839,17 @@ protected:
                 socket->waitForConnected(timeout);
             return this->checkConnProc();
         }
+        return false;
     }
 
     bool closeProc(quint32 timeout = INFINITE) const override {
         if (socket->state() == QAbstractSocket::UnconnectedState)
             return true;
+        if (m_isMulticast) {
+            leaveGroup();
+            socket->close();
+            return socket->state() == QAbstractSocket::UnconnectedState;
+        }
         socket->disconnectFromHost();
         if (timeout)
             socket->waitForDisconnected(timeout);
@@ -653,23 +866,31 @@ protected:
     bool inboxProc(quint32 timeout = IGNORE) override {
         if (timeout)
             socket->waitForReadyRead(timeout);
-        m_bytesInbox = socket->bytesAvailable();
+        if (m_isMulticast)
+            m_bytesInbox = socket->hasPendingDatagrams() ? socket->pendingDatagramSize() : 0;
+        else
+            m_bytesInbox = socket->bytesAvailable();
         return m_bytesInbox > 0;
     }
 
     bool recvProc(QByteArray &buffer, quint32 timeout = INFINITE) override {
+        if (m_isMulticast)
+            return recvDatagrams(buffer, timeout);
+
         int recvBytes = socket->bytesAvailable();
         if (timeout && !recvBytes) {
             socket->waitForReadyRead(timeout);
             recvBytes = socket->bytesAvailable();
         }
-        buffer = socket->readAll();
+        readInto(socket, buffer, recvBytes);
         m_bytesRecv = buffer.size();
         return (bool)m_bytesRecv;
     }
 
     bool checkConnProc(bool emergency = false) const override {
         QAbstractSocket::SocketState curStat = socket->state();
+        if (m_isMulticast)
+            return curStat == QAbstractSocket::BoundState;
         return curStat == QAbstractSocket::ConnectedState;
     }
 
@@ -677,6 +898,85 @@ private:
     QUdpSocket *socket;
     quint16 m_port;
     QHostAddress hostAddr;
+    QNetworkInterface m_iface;
+    bool m_isMulticast = false;
+
+    // Binds the group port with SO_REUSEADDR/SO_REUSEPORT set before bind(),
+    // which QUdpSocket::bind() cannot do on every platform. On Unix the
+    // socket is bound to the group address itself, so unicast and other
+    // groups sent to the same port are not delivered to it; Windows only
+    // accepts a wildcard bind.
+    bool bindShared() const {
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+        int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0)
+            return false;
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(m_port);
+        addr.sin_addr.s_addr = htonl(hostAddr.toIPv4Address());
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            !socket->setSocketDescriptor(fd, QAbstractSocket::BoundState)) {
+            ::close(fd);
+            return false;
+        }
+        return true;
+#else
+        return socket->bind(QHostAddress::AnyIPv4, m_port,
+                            QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint);
+#endif
+    }
+
+    bool joinGroup() const {
+        if (!bindShared())
+            return false;
+
+        bool isOK;
+        if (m_iface.isValid()) {
+            socket->setMulticastInterface(m_iface);
+            isOK = socket->joinMulticastGroup(hostAddr, m_iface);
+        }
+        else {
+            isOK = socket->joinMulticastGroup(hostAddr);
+        }
+        if (!isOK)
+            socket->close();
+        return isOK && this->checkConnProc();
+    }
+
+    void leaveGroup() const {
+        if (m_iface.isValid())
+            socket->leaveMulticastGroup(hostAddr, m_iface);
+        else
+            socket->leaveMulticastGroup(hostAddr);
+    }
+
+    // An unconnected socket cannot use readAll(); drain datagram by datagram.
+    bool recvDatagrams(QByteArray &buffer, quint32 timeout) {
+        if (timeout && !socket->hasPendingDatagrams())
+            socket->waitForReadyRead(timeout);
+
+        int total = 0;
+        buffer.resize(0);
+        while (socket->hasPendingDatagrams()) {
+            qint64 size = socket->pendingDatagramSize();
+            if (size <= 0) {
+                socket->readDatagram(nullptr, 0);
+                continue;
+            }
+            buffer.resize(total + int(size));
+            qint64 n = socket->readDatagram(buffer.data() + total, size);
+            if (n > 0)
+                total += int(n);
+        }
+        buffer.resize(total);
+        m_bytesRecv = total;
+        return (bool)m_bytesRecv;
+    }
 
     void handleError(QAbstractSocket::SocketError err) {
         Q_UNUSED(err);
@@ -689,40 +989,105 @@ private:
     }
 };
 
+// SerialComm class
 #include <QtSerialPort/QSerialPort>
 #include <QtSerialPort/QSerialPortInfo>
 #include <QList>
+#include <cstring>
+
+// Frame layout on the wire (both directions):
+//   [0xA5][0x5A][len lo][len hi][payload: len bytes][xor of payload bytes]
+// The payload carries whole (angle, distance) records so concatenated
+// payloads can be decoded the same way as a TCP/UDP stream.
 class SerialComm : public Comm {
     Q_OBJECT
 
 public:
+    static constexpr quint8 syncByte0 = 0xA5;
+    static constexpr quint8 syncByte1 = 0x5A;
+    static constexpr int headerSize = 4;
+    static constexpr int trailerSize = 1;
+    static constexpr int maxPayload = 16 * 1024;
+    static constexpr int rxCapacity = 4 * (headerSize + maxPayload + trailerSize);
+    static constexpr int inboxCapacity = 256 * 1024;
+
     SerialComm(QObject *parent = nullptr, int commID = 0)
         : Comm(parent, commID), serial(new QSerialPort(this)) {
+        m_rxBuf.resize(rxCapacity);
+        m_inbox.reserve(inboxCapacity);
+        m_txBuf.reserve(headerSize + maxPayload + trailerSize);
         QObject::connect(serial, &QSerialPort::errorOccurred, this, &SerialComm::handleError);
-        //QObject::connect(serial, &QSerialPort::readyRead, this, &SerialComm::handleReadyRead);
+        QObject::connect(serial, &QSerialPort::readyRead, this, &SerialComm::handleReadyRead);
     }
     ~SerialComm() { serial->close(); }
 
+    quint32 framesRecved() const {
+        return m_framesRecved;
+    }
+
+    quint32 framesDropped() const {
+        return m_framesDropped;
+    }
+
+    quint32 bytesDiscarded() const {
+        return m_bytesDiscarded;
+    }
+
+    // Valid frames dropped because the inbox was full.
+    quint32 framesOverflowed() const {
+        return m_framesOverflowed;
+    }
+
+    static quint8 checksum(const uchar *data, int size) {
+        quint8 sum = 0;
+        for (int i = 0; i < size; i++)
+            sum ^= data[i];
+        return sum;
+    }
+
+    static void frame(const QByteArray &payload, QByteArray &out) {
+        const int len = payload.size();
+        out.resize(headerSize + len + trailerSize);
+        uchar *dst = reinterpret_cast<uchar *>(out.data());
+        dst[0] = syncByte0;
+        dst[1] = syncByte1;
+        dst[2] = quint8(len & 0xFF);
+        dst[3] = quint8(len >> 8);
+        memcpy(dst + headerSize, payload.constData(), len);
+        dst[headerSize + len] = checksum(dst + headerSize, len);
+    }
+
 protected:
+    // connString: port name or device path (e.g. COM3, /dev/ttyUSB0, /dev/pts/5)
+    // connNum: baud rate, non-standard rates are passed through to the driver.
     bool setConnInfoProc(QString connString, int connNum, void* connInfo) override {
-        Q_UNUSED(connNum)
         Q_UNUSED(connInfo)
-        m_connAvailable = false;
+        if (connString.isEmpty() || connNum <= 0)
+            return false;
 
         serial->setPortName(connString);
-        serial->setBaudRate(connNum);
+        if (!serial->setBaudRate(connNum))
+            return false;
+        serial->setDataBits(QSerialPort::Data8);
+        serial->setParity(QSerialPort::NoParity);
+        serial->setStopBits(QSerialPort::OneStop);
+        serial->setFlowControl(QSerialPort::NoFlowControl);
 
-        m_connAvailable = true;
-        return m_connAvailable;
+        m_rxLen = 0;
+        m_inbox.resize(0);
+        return true;
     }
 
     bool connectProc(quint32 timeout = INFINITE) const override {
-
-        if (!m_connAvailable) return false;
-
+        Q_UNUSED(timeout)
+        if (!m_connAvailable)
+            return false;
         if (serial->isOpen())
             return true;
-        return serial->open(QIODevice::ReadWrite);
+        if (!serial->open(QIODevice::ReadWrite))
+            return false;
+        serial->clear();
+        return true;
     }
 
     bool closeProc(quint32 timeout = INFINITE) const override {
@@ -736,28 +1101,39 @@ protected:
     }
 
     bool sendProc(QByteArray &data, quint32 timeout = INFINITE) override {
-        m_bytesSent = serial->write(data);
+        if (data.size() > maxPayload)
+            return false;
+        frame(data, m_txBuf);
+        qint64 written = serial->write(m_txBuf);
         if (timeout)
             serial->waitForBytesWritten(timeout);
+        m_bytesSent = (written == m_txBuf.size()) ? data.size() : 0;
         return m_bytesSent == data.size();
     }
 
     bool inboxProc(quint32 timeout = IGNORE) override {
-        if (timeout)
+        if (timeout && m_inbox.isEmpty())
             serial->waitForReadyRead(timeout);
-        m_bytesInbox = serial->bytesAvailable();
+        m_bytesInbox = m_inbox.size();
         return m_bytesInbox > 0;
     }
 
+    // Hands out the payloads of every frame validated since the last call.
+    // The inbox itself is swapped out and the caller's buffer becomes the
+    // next inbox, so the two circulate instead of being copied; reserve()
+    // only allocates while a buffer is new to the rotation.
     bool recvProc(QByteArray &buffer, quint32 timeout = INFINITE) override {
-        int recvBytes = serial->bytesAvailable();
-        if (timeout && !recvBytes) {
+        if (timeout && m_inbox.isEmpty())
             serial->waitForReadyRead(timeout);
-            recvBytes = serial->bytesAvailable();
+        m_bytesRecv = m_inbox.size();
+        if (!m_bytesRecv) {
+            buffer.resize(0);
+            return false;
         }
-        buffer = serial->readAll();
-        m_bytesRecv = buffer.size();
-        return (bool)m_bytesRecv;
+        buffer.swap(m_inbox);
+        m_inbox.reserve(inboxCapacity);
+        m_inbox.resize(0);
+        return true;
     }
 
     bool checkConnProc(bool emergency = false) const override {
@@ -779,51 +1155,93 @@ protected:
         QSerialPort::BaudRate baudRate;
     };
 
-    // Config* getConfig() {
-    //     if (!m_connInfo)
-    //         m_connInfo = &hConfig;
-    //     return m_connInfo;
-    // }
-
-    // void setConfig(Config* config) {
-    //     m_connInfo = config;
-    // }
-
 private:
-    Config hConfig = { 0 };
-    Config *m_connInfo = nullptr;
     QSerialPort *serial = nullptr;
-    bool m_connAvailable = false;
     QList<QSerialPortInfo> comports;
 
-    // void handleError(QSerialPort::SerialPortError err) {
-    //     if (err == QSerialPort::ResourceError)
-    //         checkConn(true);
-    //     raiseAlert((int)err, serial->errorString());
-    // }
+    QByteArray m_rxBuf;     // raw bytes, fixed capacity
+    int m_rxLen = 0;
+    QByteArray m_inbox;     // validated payloads waiting for recvProc, at most inboxCapacity
+    QByteArray m_txBuf;
+    quint32 m_framesRecved = 0;
+    quint32 m_framesDropped = 0;
+    quint32 m_bytesDiscarded = 0;
+    quint32 m_framesOverflowed = 0;
 
     void handleError(QSerialPort::SerialPortError err) {
-        if (err != QSerialPort::NoError) {
-            this->raiseAlert((int)err, serial->errorString());
+        if (err == QSerialPort::NoError)
+            return;
+        if (err == QSerialPort::ResourceError && !this->isClosed())
+            checkConn(true);
+        this->raiseAlert((int)err, serial->errorString());
+    }
+
+    void handleReadyRead() {
+        for (;;) {
+            if (m_rxLen == rxCapacity) {
+                // A full buffer that still holds no frame is garbage.
+                m_bytesDiscarded += m_rxLen;
+                m_rxLen = 0;
+            }
+            qint64 n = serial->read(m_rxBuf.data() + m_rxLen, rxCapacity - m_rxLen);
+            if (n <= 0)
+                break;
+            m_rxLen += int(n);
+            parseFrames();
         }
     }
 
-// private:
-//     QSerialPort *serial;
+    void parseFrames() {
+        uchar *buf = reinterpret_cast<uchar *>(m_rxBuf.data());
+        int pos = 0;
+        while (m_rxLen - pos >= headerSize) {
+            if (buf[pos] != syncByte0 || buf[pos + 1] != syncByte1) {
+                // Resync: skip to the next candidate sync byte.
+                const void *next = memchr(buf + pos + 1, syncByte0, m_rxLen - pos - 1);
+                int skip = next ? int(static_cast<const uchar *>(next) - (buf + pos))
+                                : m_rxLen - pos;
+                m_bytesDiscarded += skip;
+                pos += skip;
+                continue;
+            }
 
-//     void handleError(QSerialPort::SerialPortError err) {
-//         if (err != QSerialPort::NoError) {
-//             this->raiseAlert((int)err, serial->errorString());
-//         }
-//     }
+            const int len = buf[pos + 2] | (buf[pos + 3] << 8);
+            const int frameSize = headerSize + len + trailerSize;
+            if (len > maxPayload) {
+                m_framesDropped++;
+                m_bytesDiscarded++;
+                pos++;
+                continue;
+            }
+            if (m_rxLen - pos < frameSize)
+                break;
+
+            const uchar *payload = buf + pos + headerSize;
+            if (checksum(payload, len) != payload[len]) {
+                m_framesDropped++;
+                m_bytesDiscarded++;
+                pos++;
+                continue;
+            }
 
-//     void handleReadyRead() {
-//         if (serial->bytesAvailable()) {
-//             emit onProgress(this, eProgress::inbox, serial->bytesAvailable());
-//             QCoreApplication::processEvents();
-//         }
-//     }
+            if (m_inbox.size() + len > inboxCapacity) {
+                // Nobody is reading; frames hold whole records, so dropping
+                // the frame keeps the stream aligned.
+                m_framesOverflowed++;
+            }
+            else {
+                m_inbox.append(reinterpret_cast<const char *>(payload), len);
+                m_framesRecved++;
+                markArrival();
+            }
+            pos += frameSize;
+        }
 
+        if (pos > 0) {
+            memmove(buf, buf + pos, m_rxLen - pos);
+            m_rxLen -= pos;
+        }
+    }
 };
 
 #endif // COMM_H
@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CDECODER_H
+#define CDECODER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+#include <QtCore/QtGlobal>
+#include <QtCore/QtNumeric>
+#include <cstring>
+#include <type_traits>
+
+#include "CScan.h"
+#include "CSimd.h"
+
+// Turns received bytes into a scan. A decoder belongs to one connection:
+// it carries a record split across two receives over to the next one, for
+// range-only formats keeps counting beams across receives, and follows the
+// revolution to time the beams.
+class CDecoder {
+public:
+    // Field types that occur on the wire.
+    enum class eField { none, f32, u16, i16, u32, i32 };
+
+    // Runtime description of a packet format, for CGenericDecoder.
+    struct Layout {
+        eField angle = eField::f32;     // none: angle = startAngle + beam * resolution
+        eField range = eField::f32;
+        bool  bigEndian = true;
+        float angleScale = 1.0f;        // wire units -> deg
+        float rangeScale = 1.0f;        // wire units -> mm
+        int   beams = 1200;             // per revolution
+        float resolution = 0.3f;        // deg per beam
+        float startAngle = 0.0f;        // deg
+    };
+
+    virtual ~CDecoder() {}
+
+    virtual Layout layout() const = 0;
+    // Replaces scan with the records completed by raw.
+    virtual void decode(const QByteArray &raw, CScan &scan) = 0;
+    // Forgets carried bytes and the beam count, e.g. after reconnecting.
+    virtual void reset() = 0;
+
+    // Fills scan.time() for a decoded receive whose last beam arrived at
+    // arrival (CClock nsecs): beams are one beam period apart, the period
+    // being measured between the stamps at which the angle wraps. Returns
+    // the revolutions completed within scan.
+    int timeScan(CScan &scan, qint64 arrival)
+    {
+        const int count = scan.size();
+        if (count <= 0)
+            return 0;
+        const double beamPeriod = m_period / qMax(1, layout().beams);
+        const float *angle = scan.angle();
+        float *time = scan.time();
+        for (int i = 0; i < count; i++)
+            time[i] = float(i * beamPeriod);
+
+        int revolutions = 0;
+        for (int i = 0; i < count; i++) {
+            if (wraps(m_lastAngle, angle[i])) {
+                const qint64 wrap = arrival - qint64((count - 1 - i) * beamPeriod * 1e9);
+                const double measured = (wrap - m_lastWrap) / 1e9;
+                if (m_lastWrap && measured > 0.0 && measured < maxPeriod) {
+                    m_period = m_measured ? m_period + (measured - m_period) * periodWeight : measured;
+                    m_measured = true;
+                }
+                m_lastWrap = wrap;
+                revolutions++;
+            }
+            m_lastAngle = angle[i];
+        }
+        return revolutions;
+    }
+
+    // angle starts a new revolution after the beam at previous (deg);
+    // never after a NaN.
+    static bool wraps(float previous, float angle)
+    {
+        return angle < previous - 180.0f;
+    }
+
+    // Seconds per revolution, as last measured; 0.1 until then. Only stable
+    // on the thread that decodes.
+    double scanPeriod() const { return m_period; }
+
+    static int fieldSize(eField field)
+    {
+        return field == eField::none ? 0 : field == eField::u16 || field == eField::i16 ? 2 : 4;
+    }
+
+    // Packet bytes for angles in deg and ranges in mm, as a sensor of this
+    // layout would send them. Used to feed decoders without a sensor.
+    static QByteArray encode(const Layout &layout, const float *angle, const float *range, int count)
+    {
+        QByteArray packet;
+        packet.reserve(count * (fieldSize(layout.angle) + fieldSize(layout.range)));
+        for (int i = 0; i < count; i++) {
+            put(packet, layout.angle, layout.bigEndian, angle[i] / layout.angleScale);
+            put(packet, layout.range, layout.bigEndian, range[i] / layout.rangeScale);
+        }
+        return packet;
+    }
+
+private:
+    static void put(QByteArray &packet, eField field, bool bigEndian, double value)
+    {
+        uchar bytes[4];
+        quint32 word = 0;
+        if (field == eField::f32) {
+            const float f = float(value);
+            memcpy(&word, &f, sizeof(word));
+        }
+        else {
+            word = quint32(qRound64(value));
+        }
+        const int size = fieldSize(field);
+        if (size == 2)
+            bigEndian ? qToBigEndian(quint16(word), bytes) : qToLittleEndian(quint16(word), bytes);
+        else if (size == 4)
+            bigEndian ? qToBigEndian(word, bytes) : qToLittleEndian(word, bytes);
+        packet.append(reinterpret_cast<const char *>(bytes), size);
+    }
+
+protected:
+    // For reset(): the next wrap starts a new measurement. The period is
+    // kept, the sensor is most likely the same one.
+    void resetRevolution()
+    {
+        m_lastAngle = qQNaN();
+        m_lastWrap = 0;
+    }
+
+private:
+    static constexpr double maxPeriod = 1.0;        // s; longer means receives were lost
+    static constexpr double periodWeight = 0.25;    // of each later measurement
+
+    double m_period = 0.1;      // 10 Hz
+    float m_lastAngle = qQNaN();
+    qint64 m_lastWrap = 0;
+    bool m_measured = false;
+};
+
+// Wire type of each field type, and the unsigned word it is swapped as.
+template <class T> struct CWireField;
+template <> struct CWireField<float>   { typedef quint32 Word; static const CDecoder::eField field = CDecoder::eField::f32; };
+template <> struct CWireField<quint16> { typedef quint16 Word; static const CDecoder::eField field = CDecoder::eField::u16; };
+template <> struct CWireField<qint16>  { typedef quint16 Word; static const CDecoder::eField field = CDecoder::eField::i16; };
+template <> struct CWireField<quint32> { typedef quint32 Word; static const CDecoder::eField field = CDecoder::eField::u32; };
+template <> struct CWireField<qint32>  { typedef quint32 Word; static const CDecoder::eField field = CDecoder::eField::i32; };
+struct CNoField {};
+template <> struct CWireField<CNoField> { static const CDecoder::eField field = CDecoder::eField::none; };
+
+// Bulk conversion of whole records to unscaled floats. Layouts that are
+// common enough to matter get an SSE2 version; run() returns how many
+// records it converted and the caller finishes the rest one by one.
+template <class Angle, class Range, bool BigEndian>
+struct CRecordKernel {
+    static int run(const uchar *, float *, float *, int) { return 0; }
+};
+
+#ifdef LUMO_SSE2
+// Big-endian float pairs, four records per step.
+template <>
+struct CRecordKernel<float, float, true> {
+    static int run(const uchar *p, float *angle, float *range, int count)
+    {
+        int i = 0;
+        for (; i + 4 <= count; i += 4, p += 32) {
+            const __m128 lo = _mm_castsi128_ps(swap32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));
+            const __m128 hi = _mm_castsi128_ps(swap32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16))));
+            _mm_storeu_ps(angle + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(range + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        return i;
+    }
+    static __m128i swap32(__m128i v)
+    {
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    }
+};
+
+// Little-endian unsigned 16-bit pairs, four records per step.
+template <>
+struct CRecordKernel<quint16, quint16, false> {
+    static int run(const uchar *p, float *angle, float *range, int count)
+    {
+        const __m128i low = _mm_set1_epi32(0xFFFF);
+        int i = 0;
+        for (; i + 4 <= count; i += 4, p += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            _mm_storeu_ps(angle + i, _mm_cvtepi32_ps(_mm_and_si128(v, low)));
+            _mm_storeu_ps(range + i, _mm_cvtepi32_ps(_mm_srli_epi32(v, 16)));
+        }
+        return i;
+    }
+};
+
+// Little-endian unsigned 16-bit ranges alone, eight records per step.
+template <>
+struct CRecordKernel<CNoField, quint16, false> {
+    static int run(const uchar *p, float *, float *range, int count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 8 <= count; i += 8, p += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            _mm_storeu_ps(range + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+            _mm_storeu_ps(range + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+        }
+        return i;
+    }
+};
+#endif
+
+// Decoder generated from a sensor model's traits, so field types, byte
+// order, scales and record size are constants in the loop:
+//   Angle, Range      wire types (Angle = CNoField for range-only formats)
+//   bigEndian
+//   angleScale(), rangeScale(), resolution(), startAngle()
+//   beams
+template <class Traits>
+class CPacketDecoder : public CDecoder {
+public:
+    typedef typename Traits::Angle Angle;
+    typedef typename Traits::Range Range;
+    static const bool implicitAngle = CWireField<Angle>::field == eField::none;
+    static const int AngleSize = implicitAngle ? 0 : int(sizeof(Angle));
+    static const int RecordSize = AngleSize + int(sizeof(Range));
+
+    Layout layout() const override
+    {
+        Layout l;
+        l.angle = CWireField<Angle>::field;
+        l.range = CWireField<Range>::field;
+        l.bigEndian = Traits::bigEndian;
+        l.angleScale = Traits::angleScale();
+        l.rangeScale = Traits::rangeScale();
+        l.beams = Traits::beams;
+        l.resolution = Traits::resolution();
+        l.startAngle = Traits::startAngle();
+        return l;
+    }
+
+    void decode(const QByteArray &raw, CScan &scan) override
+    {
+        const uchar *p = reinterpret_cast<const uchar *>(raw.constData());
+        const uchar *end = p + raw.size();
+        const int count = (m_carried + raw.size()) / RecordSize;
+        scan.resize(count);
+        float *angle = scan.angle();
+        float *range = scan.range();
+        int i = 0;
+        if (m_carried) {
+            const int fill = qMin(RecordSize - m_carried, int(end - p));
+            memcpy(m_carry + m_carried, p, fill);
+            m_carried += fill;
+            p += fill;
+            if (m_carried < RecordSize)
+                return;
+            convert(m_carry, angle, range, 1);
+            m_carried = 0;
+            i = 1;
+        }
+        convert(p, angle + i, range + i, count - i);
+        p += (count - i) * RecordSize;
+        m_carried = int(end - p);
+        memcpy(m_carry, p, m_carried);
+
+        if (implicitAngle) {
+            for (int k = 0; k < count; k++) {
+                angle[k] = Traits::startAngle() + m_beam * Traits::resolution();
+                if (++m_beam == Traits::beams)
+                    m_beam = 0;
+            }
+        }
+    }
+
+    void reset() override
+    {
+        m_carried = 0;
+        m_beam = 0;
+        resetRevolution();
+    }
+
+private:
+    uchar m_carry[RecordSize];
+    int m_carried = 0;
+    int m_beam = 0;
+
+    static void convert(const uchar *p, float *angle, float *range, int count)
+    {
+        int i = CRecordKernel<Angle, Range, Traits::bigEndian>::run(p, angle, range, count);
+        for (p += i * RecordSize; i < count; i++, p += RecordSize) {
+            readAngle(p, angle[i], std::integral_constant<bool, implicitAngle>());
+            range[i] = load<Range>(p + AngleSize);
+        }
+        scale(angle, count, Traits::angleScale());
+        scale(range, count, Traits::rangeScale());
+    }
+
+    static inline void scale(float *v, int count, float factor)
+    {
+        if (factor == 1.0f)
+            return;
+        for (int i = 0; i < count; i++)
+            v[i] *= factor;
+    }
+
+    static inline void readAngle(const uchar *, float &, std::true_type) {}
+    static inline void readAngle(const uchar *p, float &angle, std::false_type)
+    {
+        angle = load<Angle>(p);
+    }
+
+    template <class T>
+    static float load(const uchar *p)
+    {
+        typedef typename CWireField<T>::Word Word;
+        const Word word = Traits::bigEndian ? qFromBigEndian<Word>(p) : qFromLittleEndian<Word>(p);
+        T value;
+        memcpy(&value, &word, sizeof(value));
+        return float(value);
+    }
+};
+
+// Interprets a Layout field by field at run time. Handles formats without a
+// compiled model, and is the baseline the compiled decoders are measured
+// against.
+class CGenericDecoder : public CDecoder {
+public:
+    explicit CGenericDecoder(const Layout &layout)
+        : m_layout(layout),
+          m_angleSize(fieldSize(layout.angle)),
+          m_recordSize(m_angleSize + fieldSize(layout.range))
+    {
+    }
+
+    Layout layout() const override { return m_layout; }
+
+    void decode(const QByteArray &raw, CScan &scan) override
+    {
+        const uchar *p = reinterpret_cast<const uchar *>(raw.constData());
+        const uchar *end = p + raw.size();
+        const int count = m_recordSize ? (m_carried + raw.size()) / m_recordSize : 0;
+        scan.resize(count);
+        float *angle = scan.angle();
+        float *range = scan.range();
+        int i = 0;
+        if (m_carried && m_recordSize) {
+            const int fill = qMin(m_recordSize - m_carried, int(end - p));
+            memcpy(m_carry + m_carried, p, fill);
+            m_carried += fill;
+            p += fill;
+            if (m_carried < m_recordSize)
+                return;
+            convert(m_carry, angle[0], range[0]);
+            m_carried = 0;
+            i = 1;
+        }
+        for (; i < count; i++, p += m_recordSize)
+            convert(p, angle[i], range[i]);
+        m_carried = m_recordSize ? int(end - p) : 0;
+        memcpy(m_carry, p, m_carried);
+    }
+
+    void reset() override
+    {
+        m_carried = 0;
+        m_beam = 0;
+        resetRevolution();
+    }
+
+private:
+    Layout m_layout;
+    int m_angleSize;
+    int m_recordSize;
+    uchar m_carry[8];
+    int m_carried = 0;
+    int m_beam = 0;
+
+    void convert(const uchar *p, float &angle, float &range)
+    {
+        if (m_layout.angle == eField::none) {
+            angle = m_layout.startAngle + m_beam * m_layout.resolution;
+            if (++m_beam == m_layout.beams)
+                m_beam = 0;
+        }
+        else {
+            angle = read(p, m_layout.angle) * m_layout.angleScale;
+        }
+        range = read(p + m_angleSize, m_layout.range) * m_layout.rangeScale;
+    }
+
+    float read(const uchar *p, eField field) const
+    {
+        const bool big = m_layout.bigEndian;
+        switch (field) {
+        case eField::f32: {
+            const quint32 word = big ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+            float value;
+            memcpy(&value, &word, sizeof(value));
+            return value;
+        }
+        case eField::u16:
+            return big ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+        case eField::i16:
+            return qint16(big ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p));
+        case eField::u32:
+            return big ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+        case eField::i32:
+            return qint32(big ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p));
+        default:
+            return 0.0f;
+        }
+    }
+};
+
+#endif // CDECODER_H
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CDECODERREGISTRY_H
+#define CDECODERREGISTRY_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <memory>
+
+#include "CDecoder.h"
+
+// Sensor models with a compiled decoder. Each model describes its packet
+// layout as traits for CPacketDecoder; add one here and to the registry.
+namespace CSensorModel {
+
+// (angle deg, range mm) as big-endian float pairs: what Lumos sensors send.
+struct LumosFloat {
+    typedef float Angle;
+    typedef float Range;
+    static const bool bigEndian = true;
+    static const int beams = 1200;
+    static constexpr float angleScale() { return 1.0f; }
+    static constexpr float rangeScale() { return 1.0f; }
+    static constexpr float resolution() { return 0.3f; }
+    static constexpr float startAngle() { return 0.0f; }
+};
+
+} // namespace CSensorModel
+
+// Picks the decoder for a sensor model named in the connection settings.
+class CDecoderRegistry {
+public:
+    struct Entry {
+        QString model;
+        QString title;
+        CDecoder *(*create)();
+    };
+
+    static const QVector<Entry> &entries()
+    {
+        static const QVector<Entry> list = {
+            { "lumos-float", "Lumos (float)", &make<CSensorModel::LumosFloat> },
+        };
+        return list;
+    }
+
+    static QString defaultModel() { return entries().first().model; }
+
+    // Null for an unknown model.
+    static std::shared_ptr<CDecoder> create(const QString &model)
+    {
+        for (const Entry &entry : entries()) {
+            if (entry.model == model)
+                return std::shared_ptr<CDecoder>(entry.create());
+        }
+        return nullptr;
+    }
+
+private:
+    template <class Traits>
+    static CDecoder *make() { return new CPacketDecoder<Traits>(); }
+};
+
+#endif // CDECODERREGISTRY_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CDESKEW_H
+#define CDESKEW_H
+
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QtMath>
+#include <cmath>
+
+#include "CPose2D.h"
+#include "CScan.h"
+#include "CSimd.h"
+
+// Removes the smear of a moving sensor from a scan. Each return is timed
+// from the scan's time channel, which the decoder fills from the measured
+// revolution period; a scan without one is timed from its angle: a beam
+// that is a degrees before the last beam was measured a / 360 of a scan
+// period earlier. Points are moved into the sensor frame at the last beam,
+// assuming the sensor keeps the rate of its most recent measured motion.
+// The per-point rotation is small, so cos/sin use short series and the
+// correction runs four points at a time.
+class CDeskew {
+public:
+    // For scans without a time channel.
+    void setScanPeriod(double seconds) { m_period = seconds; }
+    double scanPeriod() const { return m_period; }
+
+    // Seconds before the last beam for each kept point of the last apply().
+    const float *age() const { return m_age.constData(); }
+
+    // Dropouts are skipped. motion: sensor motion (end relative to start)
+    // over interval seconds. Writes the corrected points in meters and
+    // returns how many were kept.
+    int apply(const CScan &scan, const CPose2D &motion, double interval, QVector<QPointF> &out)
+    {
+        const int count = scan.size();
+        m_x.resize(count);
+        m_y.resize(count);
+        m_age.resize(count);
+        out.resize(0);
+        if (count <= 0)
+            return 0;
+
+        const float *angle = scan.angle();
+        const float *range = scan.range();
+        const float *time = scan.time();
+        const float *x = scan.x();
+        const float *y = scan.y();
+        const float lastAngle = angle[count - 1];
+        const float secPerDeg = float(m_period / 360.0);
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            if (range[i] <= 0.0f)
+                continue;
+            m_x[n] = x[i];
+            m_y[n] = y[i];
+            if (time) {
+                m_age[n] = time[count - 1] - time[i];
+            }
+            else {
+                float before = lastAngle - angle[i];
+                if (before < 0.0f)
+                    before += 360.0f;
+                m_age[n] = before * secPerDeg;
+            }
+            n++;
+        }
+
+        // Pose at age t relative to the end frame is t / interval of inverse(motion).
+        const CPose2D back = motion.inverse();
+        const float rate = interval > 0.0 ? float(1.0 / interval) : 0.0f;
+        correct(m_x.data(), m_y.data(), m_age.constData(), n,
+                float(back.x) * rate, float(back.y) * rate, float(back.theta) * rate);
+
+        out.resize(n);
+        for (int i = 0; i < n; i++)
+            out[i] = QPointF(m_x[i], m_y[i]);
+        return n;
+    }
+
+private:
+    double m_period = 0.1;  // 10 Hz
+    QVector<float> m_x, m_y, m_age;
+
+    // p' = R(w t) p + (vx, vy) t
+    static void correct(float *x, float *y, const float *t, int n, float vx, float vy, float w)
+    {
+        int i = 0;
+#ifdef LUMO_SSE2
+        const __m128 vvx = _mm_set1_ps(vx), vvy = _mm_set1_ps(vy), vw = _mm_set1_ps(w);
+        const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+        const __m128 sixth = _mm_set1_ps(1.0f / 6.0f), c24 = _mm_set1_ps(1.0f / 24.0f);
+        for (; i <= n - 4; i += 4) {
+            const __m128 ti = _mm_loadu_ps(t + i);
+            const __m128 a = _mm_mul_ps(vw, ti);
+            const __m128 a2 = _mm_mul_ps(a, a);
+            const __m128 c = _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(half, a2)), _mm_mul_ps(c24, _mm_mul_ps(a2, a2)));
+            const __m128 s = _mm_mul_ps(a, _mm_sub_ps(one, _mm_mul_ps(sixth, a2)));
+            const __m128 xi = _mm_loadu_ps(x + i), yi = _mm_loadu_ps(y + i);
+            _mm_storeu_ps(x + i, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(c, xi), _mm_mul_ps(s, yi)), _mm_mul_ps(vvx, ti)));
+            _mm_storeu_ps(y + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(s, xi), _mm_mul_ps(c, yi)), _mm_mul_ps(vvy, ti)));
+        }
+#endif
+        for (; i < n; i++) {
+            const float a = w * t[i], a2 = a * a;
+            const float c = 1.0f - 0.5f * a2 + a2 * a2 / 24.0f;
+            const float s = a * (1.0f - a2 / 6.0f);
+            const float xi = x[i], yi = y[i];
+            x[i] = c * xi - s * yi + vx * t[i];
+            y[i] = s * xi + c * yi + vy * t[i];
+        }
+    }
+};
+
+#endif // CDESKEW_H
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CINGEST_H
+#define CINGEST_H
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <memory>
+
+#include "CScanJob.h"
+#include "CPipeline.h"
+#include "CJobPool.h"
+#include "CDecoder.h"
+#include "CScanFilter.h"
+#include "CSafetyZones.h"
+#include "CScanSegmenter.h"
+#include "CLineExtractor.h"
+#include "CBackgroundModel.h"
+#include "CDeskew.h"
+#include "CScanMatcher.h"
+#include "COccupancyGrid.h"
+#include "CMapStore.h"
+#include "CScanServer.h"
+#include "CLatency.h"
+#include "CMetrics.h"
+#include "CTrace.h"
+
+// Everything between a received buffer and a processed scan, for the
+// toolbar connection of the viewer or a headless process. decode -> filter
+// -> transform run on the work pool, one scan per stage at a time, so
+// consecutive scans overlap; publish and deliver touch sockets and the
+// receiver and run on the owner's thread. Every receive is decoded, since
+// the decoder carries partial records from one to the next; decoded scans
+// that fall behind are dropped, oldest first.
+class CIngest : public QObject {
+    Q_OBJECT
+
+public:
+    // Either may be null.
+    CIngest(CScanServer *server, CSafetyZones *zones, QObject *parent = nullptr)
+        : QObject(parent), m_server(server), m_zones(zones), m_pipeline(this)
+    {
+        m_pipeline.addStage("decode", [this](CScanJob &job) {
+            const bool ok = decode(job);
+            job.times.decoded = CClock::nsecs();
+            if (!ok) {
+                CMetricCounters::add(m_counters.partialReceives);
+                return false;
+            }
+            CMetricCounters::add(m_counters.points, job.scan.size());
+            return true;
+        }, 2, CPipeline<CScanJob>::eThread::pool, CPipeline<CScanJob>::eFull::grow);
+        m_pipeline.addStage("filter", [this](CScanJob &job) {
+            LUMO_TRACE("filter");
+            m_filter.apply(job.scan);
+            if (m_zones && !m_zones->zones().isEmpty()) {
+                m_zones->setBeams(job.decoder->layout().beams);
+                m_zones->evaluate(job.scan, job.times.arrival);
+            }
+            return true;
+        });
+        m_pipeline.addStage("transform", [this](CScanJob &job) {
+            LUMO_TRACE("transform");
+            const QVector<CScanSegmenter::Cluster> &clusters = m_segmenter.segment(job.scan);
+            job.clusters = job.arena.copy(clusters.constData(), clusters.size());
+            job.clusterCount = clusters.size();
+            const QVector<CLineExtractor::Segment> &segments = m_lineExtractor.extract(m_segmenter);
+            job.segments = job.arena.copy(segments.constData(), segments.size());
+            job.segmentCount = segments.size();
+            detectChanges(job);
+            primaryScan(job);
+            integrateMap(job);
+            return true;
+        });
+        m_pipeline.addStage("publish", [this](CScanJob &job) {
+            LUMO_TRACE("publish");
+            if (m_server) {
+                m_server->publish(job.scan);
+                m_server->publishLines(job.segments, job.segmentCount);
+            }
+            job.times.published = CClock::nsecs();
+            m_latency.published(job.times);
+            return true;
+        }, 4, CPipeline<CScanJob>::eThread::main);
+        m_pipeline.addStage("deliver", [this](CScanJob &job) {
+            emit scanReady(job);
+            return true;
+        }, 1, CPipeline<CScanJob>::eThread::main);
+    }
+    ~CIngest() override {
+        close();
+    }
+
+    // Map tiles are paged from path; without it the map stays in memory.
+    bool openMap(const QString &path) {
+        if (!m_store.open(path, sizeof(COccupancyGrid::Tile), m_grid.cellSize(), COccupancyGrid::LevelCount))
+            return false;
+        m_grid.setStore(&m_store);
+        QObject::connect(&m_flushTimer, &QTimer::timeout, this, [this]() {
+            QMutexLocker locker(m_grid.mutex());
+            m_grid.flush();
+        });
+        m_flushTimer.start(mapFlushInterval);
+        return true;
+    }
+
+    // Stops the stages and writes the map back; nothing runs afterwards.
+    void close() {
+        if (m_closed)
+            return;
+        m_closed = true;
+        m_pipeline.close();
+        m_flushTimer.stop();
+        m_grid.flush();
+        m_store.close();
+    }
+
+    // Decoder of the current connection; scans already queued keep theirs.
+    void setDecoder(const std::shared_ptr<CDecoder> &decoder) {
+        m_decoder = decoder;
+    }
+
+    std::shared_ptr<CDecoder> decoder() const {
+        return m_decoder;
+    }
+
+    // The connection was (re)established: the decoder drops the bytes
+    // carried from the old stream before it decodes the next receive. The
+    // reset runs in the decode stage, after the scans already queued.
+    void reconnected() {
+        m_reconnected = true;
+    }
+
+    // Takes raw's bytes; raw is left with a recycled buffer.
+    void push(QByteArray &raw, qint64 arrival, qint64 recv) {
+        if (!m_decoder)
+            return;
+        CPipeline<CScanJob>::JobPtr job = m_jobs.acquire();
+        job->stamp = recv;
+        job->times.arrival = arrival;
+        job->times.recv = recv;
+        CMetricCounters::add(m_counters.bytes, raw.size());
+        CMetricCounters::add(m_counters.packets);
+        job->raw.swap(raw);
+        job->decoder = m_decoder;
+        job->reconnected = m_reconnected;
+        m_reconnected = false;
+        m_pipeline.push(job);
+    }
+
+    COccupancyGrid &grid() { return m_grid; }
+    CScanFilter &filter() { return m_filter; }
+    CLatency &latency() { return m_latency; }
+    CPipeline<CScanJob> &pipeline() { return m_pipeline; }
+    const CMetricCounters &counters() const { return m_counters; }
+
+    CMetrics::Source metricsSource(int id, const QString &name) {
+        CMetrics::Source source;
+        source.id = id;
+        source.name = name;
+        source.counters = &m_counters;
+        source.dropped = [this]() { return m_pipeline.dropped(); };
+        source.depth = [this]() { return m_pipeline.depth(); };
+        return source;
+    }
+
+signals:
+    // A processed scan, on the owner's thread. The job is recycled once
+    // the receivers return.
+    void scanReady(const CScanJob &job);
+
+private:
+    const int mapFlushInterval = 2000;
+
+    CScanServer *m_server;
+    CSafetyZones *m_zones;
+    std::shared_ptr<CDecoder> m_decoder;
+    CMetricCounters m_counters;
+    CLatency m_latency;
+    bool m_closed = false;
+    bool m_reconnected = false;
+
+    CScanFilter m_filter;
+    CScanSegmenter m_segmenter;
+    CLineExtractor m_lineExtractor;
+    CBackgroundModel m_background;
+    CDeskew m_deskew;
+    QVector<QPointF> m_hits;
+    CScanMatcher m_matcher;
+    COccupancyGrid m_grid;
+    CMapStore m_store;
+    QTimer m_flushTimer;
+    CPose2D m_pose, m_lastPose;
+    qint64 m_poseStamp = 0, m_lastPoseStamp = 0;
+
+    // Declared last: destroyed first, before anything its stages touch.
+    CJobPool<CScanJob> m_jobs;
+    CPipeline<CScanJob> m_pipeline;
+
+    // The job holds on to the decoder of the connection it arrived on, so a
+    // scan still queued after a reconnect is not fed to the new one.
+    bool decode(CScanJob &job) {
+        LUMO_TRACE("decode");
+        if (job.reconnected)
+            job.decoder->reset();
+        job.decoder->decode(job.raw, job.scan);
+        CMetricCounters::add(m_counters.scans, job.decoder->timeScan(job.scan, job.times.arrival));
+        return job.scan.size() > 0;
+    }
+
+    // The ingested connection is sensor 0, mounted at the vehicle origin.
+    void primaryScan(CScanJob &job) {
+        const QVector<QPointF> &points = m_segmenter.points();
+        job.sensor = 0;
+        job.points = job.arena.alloc<QPointF>(points.size());
+        for (const QPointF &point : points) {
+            if (!qIsNaN(point.x()))
+                job.points[job.pointCount++] = point;
+        }
+    }
+
+    // Collects returns that differ from the learned background.
+    void detectChanges(CScanJob &job) {
+        m_background.setBeams(job.decoder->layout().beams);
+        job.changed = m_background.update(job.scan);
+        job.changes = job.arena.alloc<QPointF>(job.changed);
+        const quint8 *mask = m_background.mask();
+        const QVector<QPointF> &points = m_segmenter.points();
+        for (int i = 0; i < job.scan.size() && job.changeCount < job.changed; i++) {
+            if (mask[i] && !qIsNaN(points[i].x()))
+                job.changes[job.changeCount++] = points[i];
+        }
+    }
+
+    // Ranges arrive in mm. Each scan is de-skewed with the last measured
+    // motion, matched against the map from a constant-velocity guess, then
+    // inserted at the estimated pose.
+    void integrateMap(CScanJob &job) {
+        const CPose2D motion = m_lastPose.inverse() * m_pose;
+        const double interval = (m_poseStamp - m_lastPoseStamp) / 1e9;
+        const int count = m_deskew.apply(job.scan, motion, interval, m_hits);
+
+        bool mapped;
+        {
+            QMutexLocker locker(m_grid.mutex());
+            mapped = m_grid.tileCount() > 0;
+        }
+        if (mapped) {
+            CPose2D guess = m_pose * motion;
+            CScanMatcher::Result match = m_matcher.match(m_grid, guess, m_hits.constData(), count);
+            m_lastPose = m_pose;
+            m_lastPoseStamp = m_poseStamp;
+            if (match.matched)
+                m_pose = match.pose;
+        }
+        m_poseStamp = job.stamp;
+
+        for (int i = 0; i < count; i++)
+            m_hits[i] = m_pose.map(m_hits[i]);
+        QMutexLocker locker(m_grid.mutex());
+        m_grid.integrate(QPointF(m_pose.x, m_pose.y), m_hits.constData(), count);
+        job.pose = m_pose;
+    }
+};
+
+#endif // CINGEST_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CJOBPOOL_H
+#define CJOBPOOL_H
+
+#include <QtCore/QVector>
+#include <atomic>
+#include <memory>
+
+// Recycles pipeline jobs. A job is free again once the pool holds its only
+// reference, i.e. every stage has finished with it or dropped it; acquire()
+// then calls its reset() and hands it out again. Jobs keep their memory
+// between scans, so once the pool has as many jobs as can be in flight,
+// acquiring one does not allocate. acquire() is meant for one thread.
+template <class Job>
+class CJobPool {
+public:
+    using JobPtr = std::shared_ptr<Job>;
+
+    JobPtr acquire()
+    {
+        for (const JobPtr &job : qAsConst(m_jobs)) {
+            if (job.use_count() == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                job->reset();
+                return job;
+            }
+        }
+        m_jobs.append(std::make_shared<Job>());
+        return m_jobs.last();
+    }
+
+    int size() const { return m_jobs.size(); }
+
+private:
+    QVector<JobPtr> m_jobs;
+};
+
+#endif // CJOBPOOL_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLATENCY_H
+#define CLATENCY_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QVector>
+#include <atomic>
+
+// Log-linear latency histogram: 8 sub-buckets per power of two of
+// microseconds, so a percentile is within about 6% of the true value.
+// record() is a few relaxed atomic operations and takes no lock; it may be
+// called from any thread while another reads.
+class CLatencyHistogram {
+public:
+    struct Summary {
+        quint64 count = 0;
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    void record(qint64 nsecs)
+    {
+        if (nsecs < 0)
+            nsecs = 0;
+        m_counts[bucket(quint64(nsecs) / 1000)].fetch_add(1, std::memory_order_relaxed);
+        qint64 max = m_max.load(std::memory_order_relaxed);
+        while (nsecs > max && !m_max.compare_exchange_weak(max, nsecs, std::memory_order_relaxed)) {}
+    }
+
+    // With reset, counts recorded while reading may land in either window.
+    Summary summary(bool reset = false)
+    {
+        quint64 counts[BucketCount];
+        quint64 total = 0;
+        for (int i = 0; i < BucketCount; i++) {
+            counts[i] = reset ? m_counts[i].exchange(0, std::memory_order_relaxed)
+                              : m_counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        const qint64 max = reset ? m_max.exchange(0, std::memory_order_relaxed)
+                                 : m_max.load(std::memory_order_relaxed);
+
+        Summary s;
+        s.count = total;
+        s.p50Ms = percentile(counts, total, 0.50, max);
+        s.p99Ms = percentile(counts, total, 0.99, max);
+        s.maxMs = max / 1e6;
+        return s;
+    }
+
+private:
+    static constexpr int SubBits = 3;
+    static constexpr int Sub = 1 << SubBits;
+    static constexpr int BucketCount = (40 - SubBits + 1) * Sub;
+
+    std::atomic<quint64> m_counts[BucketCount] = {};
+    std::atomic<qint64> m_max{0};
+
+    static int bucket(quint64 usecs)
+    {
+        if (usecs < Sub)
+            return int(usecs);
+        const int log = 63 - int(qCountLeadingZeroBits(usecs));
+        const int index = (log - SubBits + 1) * Sub + int((usecs >> (log - SubBits)) & (Sub - 1));
+        return qMin(index, BucketCount - 1);
+    }
+
+    // Middle of a bucket, in usecs.
+    static double middle(int index)
+    {
+        if (index < Sub)
+            return index + 0.5;
+        const int log = index / Sub + SubBits - 1;
+        return (Sub + index % Sub + 0.5) * double(quint64(1) << (log - SubBits));
+    }
+
+    // Never above the largest value actually recorded.
+    static double percentile(const quint64 *counts, quint64 total, double q, qint64 max)
+    {
+        if (!total)
+            return 0.0;
+        const quint64 rank = quint64(q * (total - 1)) + 1;
+        quint64 seen = 0;
+        int i = 0;
+        for (; i < BucketCount - 1; i++) {
+            seen += counts[i];
+            if (seen >= rank)
+                break;
+        }
+        return qMin(middle(i) / 1000.0, max / 1e6);
+    }
+};
+
+// Where a scan's time goes between the socket and the screen. Each scan
+// carries CClock stamps taken as it passes:
+//   arrival    data first became readable on the socket
+//   recv       the viewer started reading it (poll timer, Comm status)
+//   decoded    decode stage done (includes waiting for a pool thread)
+//   published  filter, transform and publish done
+//   painted    the first paint showing it finished
+// Scans replaced before a paint picked them up have no paint segment.
+class CLatency {
+public:
+    enum eSegment { wait, decode, process, paint, total, SegmentCount };
+
+    struct Stamps {
+        qint64 arrival = 0;
+        qint64 recv = 0;
+        qint64 decoded = 0;
+        qint64 published = 0;
+    };
+
+    struct SegmentStats : CLatencyHistogram::Summary {
+        const char *name = nullptr;
+    };
+
+    static const char *name(eSegment segment)
+    {
+        static const char *names[SegmentCount] = { "wait", "decode", "process", "paint", "total" };
+        return names[segment];
+    }
+
+    void record(eSegment segment, qint64 nsecs)
+    {
+        m_histograms[segment].record(nsecs);
+    }
+
+    // Everything up to publish; the paint segment follows once painted.
+    void published(const Stamps &stamps)
+    {
+        record(wait, stamps.recv - stamps.arrival);
+        record(decode, stamps.decoded - stamps.recv);
+        record(process, stamps.published - stamps.decoded);
+    }
+
+    void painted(const Stamps &stamps, qint64 painted)
+    {
+        record(paint, painted - stamps.published);
+        record(total, painted - stamps.arrival);
+    }
+
+    QVector<SegmentStats> stats(bool reset = false)
+    {
+        QVector<SegmentStats> list;
+        for (int i = 0; i < SegmentCount; i++) {
+            SegmentStats s;
+            static_cast<CLatencyHistogram::Summary &>(s) = m_histograms[i].summary(reset);
+            s.name = name(eSegment(i));
+            list.append(s);
+        }
+        return list;
+    }
+
+private:
+    CLatencyHistogram m_histograms[SegmentCount];
+};
+
+#endif // CLATENCY_H
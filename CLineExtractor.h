@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLINEEXTRACTOR_H
+#define CLINEEXTRACTOR_H
+
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QtNumeric>
+#include <cmath>
+
+#include "CScanSegmenter.h"
+
+// Describes each cluster of an ordered scan by line segments.
+// Clusters are split recursively at the point farthest from the end-point
+// chord (iterative end-point fit), neighbouring pieces are merged again while
+// their joint fit stays tight, and every piece is refit by total least squares.
+// Prefix sums over the run make each refit O(1), so the whole pass is linear
+// apart from the split search.
+class CLineExtractor {
+public:
+    struct Options {
+        double splitDistance = 0.03;    // max chord distance before splitting, m
+        double mergeRms = 0.015;        // max rms of a merged fit, m
+        int    minPoints = 4;           // shorter pieces are left out
+    };
+    struct Segment {
+        QPointF a, b;           // end points projected onto the fitted line, m
+        float rms = 0.0f;       // fit residual, m
+        float maxError = 0.0f;  // largest point distance from the line, m
+        int count = 0;
+    };
+
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+
+    const QVector<Segment> &segments() const { return m_segments; }
+
+    const QVector<Segment> &extract(const CScanSegmenter &segmenter)
+    {
+        m_segments.resize(0);
+        const QVector<QPointF> &points = segmenter.points();
+        for (const CScanSegmenter::Cluster &cluster : segmenter.clusters()) {
+            if (cluster.count < m_options.minPoints)
+                continue;
+            gather(points, cluster);
+            split();
+            merge();
+            for (const Range &range : qAsConst(m_ranges))
+                m_segments.append(fitSegment(range));
+        }
+        return m_segments;
+    }
+
+private:
+    struct Range {
+        int s, e;   // inclusive
+    };
+    struct Moments {
+        double x = 0.0, y = 0.0, xx = 0.0, yy = 0.0, xy = 0.0;
+    };
+    struct Line {
+        double nx, ny, d;   // nx * x + ny * y = d, relative to m_origin
+        double rms;
+    };
+
+    Options m_options;
+    QVector<Segment> m_segments;
+    QVector<QPointF> m_run;         // current cluster, relative to m_origin
+    QVector<Moments> m_sums;        // m_sums[i] covers m_run[0, i)
+    QVector<Range> m_ranges;
+    QVector<Range> m_stack;
+    QPointF m_origin;
+
+    void gather(const QVector<QPointF> &points, const CScanSegmenter::Cluster &cluster)
+    {
+        m_run.resize(0);
+        m_sums.resize(1);
+        m_sums[0] = Moments();
+        const int size = points.size();
+        int i = cluster.first;
+        m_origin = points[i];
+        for (;;) {
+            const QPointF &p = points[i];
+            if (!qIsNaN(p.x())) {
+                const QPointF q = p - m_origin;
+                Moments m = m_sums.last();
+                m.x += q.x();
+                m.y += q.y();
+                m.xx += q.x() * q.x();
+                m.yy += q.y() * q.y();
+                m.xy += q.x() * q.y();
+                m_run.append(q);
+                m_sums.append(m);
+            }
+            if (i == cluster.last)
+                break;
+            if (++i == size)
+                i = 0;
+        }
+    }
+
+    // Iterative end-point fit; ranges come out in scan order.
+    void split()
+    {
+        m_ranges.resize(0);
+        m_stack.resize(0);
+        m_stack.append(Range{0, m_run.size() - 1});
+        const double limit = m_options.splitDistance;
+        while (!m_stack.isEmpty()) {
+            const Range range = m_stack.takeLast();
+            if (range.e - range.s + 1 < m_options.minPoints)
+                continue;
+            const QPointF a = m_run[range.s];
+            const QPointF ab = m_run[range.e] - a;
+            const double len = std::sqrt(ab.x() * ab.x() + ab.y() * ab.y());
+            int worst = -1;
+            double worstDist = limit * len;
+            for (int i = range.s + 1; i < range.e; i++) {
+                const QPointF ap = m_run[i] - a;
+                const double dist = std::fabs(ab.x() * ap.y() - ab.y() * ap.x());
+                if (dist > worstDist) {
+                    worstDist = dist;
+                    worst = i;
+                }
+            }
+            if (worst < 0) {
+                m_ranges.append(range);
+                continue;
+            }
+            m_stack.append(Range{worst, range.e});
+            m_stack.append(Range{range.s, worst});
+        }
+    }
+
+    void merge()
+    {
+        if (m_ranges.size() < 2)
+            return;
+        int kept = 0;
+        for (int i = 1; i < m_ranges.size(); i++) {
+            Range &cur = m_ranges[kept];
+            const Range &next = m_ranges[i];
+            if (next.s <= cur.e + 1 && fit(cur.s, next.e).rms <= m_options.mergeRms)
+                cur.e = next.e;
+            else
+                m_ranges[++kept] = next;
+        }
+        m_ranges.resize(kept + 1);
+    }
+
+    // Total least squares over m_run[s, e] from the prefix sums.
+    Line fit(int s, int e) const
+    {
+        const Moments &hi = m_sums[e + 1], &lo = m_sums[s];
+        const double n = e - s + 1;
+        const double mx = (hi.x - lo.x) / n, my = (hi.y - lo.y) / n;
+        const double cxx = (hi.xx - lo.xx) / n - mx * mx;
+        const double cyy = (hi.yy - lo.yy) / n - my * my;
+        const double cxy = (hi.xy - lo.xy) / n - mx * my;
+        const double alpha = 0.5 * std::atan2(-2.0 * cxy, cyy - cxx);
+        Line line;
+        line.nx = std::cos(alpha);
+        line.ny = std::sin(alpha);
+        line.d = mx * line.nx + my * line.ny;
+        const double half = 0.5 * (cxx - cyy);
+        const double minEigen = 0.5 * (cxx + cyy) - std::sqrt(half * half + cxy * cxy);
+        line.rms = std::sqrt(qMax(0.0, minEigen));
+        return line;
+    }
+
+    Segment fitSegment(const Range &range) const
+    {
+        const Line line = fit(range.s, range.e);
+        double maxError = 0.0;
+        for (int i = range.s; i <= range.e; i++) {
+            const QPointF &p = m_run[i];
+            maxError = qMax(maxError, std::fabs(p.x() * line.nx + p.y() * line.ny - line.d));
+        }
+        Segment segment;
+        segment.a = project(line, m_run[range.s]) + m_origin;
+        segment.b = project(line, m_run[range.e]) + m_origin;
+        segment.rms = float(line.rms);
+        segment.maxError = float(maxError);
+        segment.count = range.e - range.s + 1;
+        return segment;
+    }
+
+    static QPointF project(const Line &line, const QPointF &p)
+    {
+        const double off = p.x() * line.nx + p.y() * line.ny - line.d;
+        return QPointF(p.x() - off * line.nx, p.y() - off * line.ny);
+    }
+};
+
+#endif // CLINEEXTRACTOR_H
@@ -20,6 +20,16 @@
 #include <QtWidgets>
 #include <QtGui>
 #include <QtCore>
+
+#include "CCloudPoints.h"
+#include "COccupancyGrid.h"
+#include "CPose2D.h"
+#include "CScanSegmenter.h"
+#include "CLineExtractor.h"
+#include "CSafetyZones.h"
+#include "CScanFusion.h"
+#include "CTrace.h"
+
 class CLumoMap : public QWidget
 {
     Q_OBJECT
@@ -34,24 +44,105 @@ public:
         penThin = QPen(lineThin.color, lineThin.thickness, lineThin.pattern);
         penThick = QPen(lineThick.color, lineThick.thickness, lineThick.pattern);
         penGrid = QPen(lineThin.color, lineThin.thickness, lineThick.pattern);
+
+        // log-odds -> color: unknown transparent, free dark, occupied bright
+        for (int i = 0; i < 256; i++) {
+            int logOdds = qint8(quint8(i));
+            if (logOdds == 0)
+                m_mapPalette[i] = qRgba(0, 0, 0, 0);
+            else if (logOdds < 0)
+                m_mapPalette[i] = qRgba(40, 40, 48, qMin(255, -logOdds * 4));
+            else
+                m_mapPalette[i] = qRgba(255, 220, 120, qMin(255, 64 + logOdds * 2));
+        }
     }
     ~CLumoMap() {}
 
-    void lumos(const QVector<QPointF>& lidarPoints)
+    void lumos(const CCloudPoints &cloudPoints)
+    {
+        cloudPoints.getPoints(m_lidarPoints);
+        update();
+    }
+    void setMap(const COccupancyGrid *map)
+    {
+        m_map = map;
+        for (auto &cache : m_tileCache)
+            cache.clear();
+        update();
+    }
+    // Setters copy into storage kept between scans instead of sharing the
+    // caller's buffers, which are recycled.
+    void setClusters(const CScanSegmenter::Cluster *clusters, int count)
+    {
+        assign(m_clusters, clusters, count);
+        update();
+    }
+    void setSegments(const CLineExtractor::Segment *segments, int count)
+    {
+        assign(m_segments, segments, count);
+        if (m_lineMode)
+            update();
+    }
+    // With more than one sensor the fused frame replaces the single-sensor points.
+    void setFusion(const CScanFusion::Frame &frame)
+    {
+        m_fused.stamp = frame.stamp;
+        m_fused.skew = frame.skew;
+        assign(m_fused.points, frame.points.constData(), frame.points.size());
+        assign(m_fused.sensors, frame.sensors.constData(), frame.sensors.size());
+        assign(m_fused.offsets, frame.offsets.constData(), frame.offsets.size());
+        update();
+    }
+    void setZones(const CSafetyZones *zones)
     {
-        m_lidarPoints = lidarPoints;
+        m_zones = zones;
         update();
     }
-    void CLumoMap::setSettings(float pixelsPerMeter, int maxConcCircles)
+    // Returns that differ from the background, in meters in the sensor frame.
+    void setChanges(const QPointF *changes, int count)
+    {
+        assign(m_changes, changes, count);
+        update();
+    }
+    // Draw the extracted segments instead of the raw points.
+    void setLineMode(bool lineMode)
+    {
+        m_lineMode = lineMode;
+        update();
+    }
+    // Sensor pose in the map frame. With follow on, the view stays centered
+    // on the sensor; the map moves underneath it.
+    void setPose(const CPose2D &pose)
+    {
+        m_pose = pose;
+        update();
+    }
+    void setFollowPose(bool follow)
+    {
+        m_followPose = follow;
+        update();
+    }
+    void setSettings(float pixelsPerMeter, int maxConcCircles)
     {
         m_pixelsPerMeter = pixelsPerMeter;
         m_maxConcCircles = maxConcCircles;
         update();
     }
+    // Text drawn over the top-left corner of the view; empty hides it.
+    void setOverlay(const QStringList &lines)
+    {
+        m_overlay = lines;
+        update();
+    }
+
+signals:
+    // Emitted when a paint has finished.
+    void painted();
 
 protected:
     void paintEvent(QPaintEvent *event) override
     {
+        LUMO_TRACE("CLumoMap::paintEvent");
         QPainter painter(this);
         painter.setRenderHint(QPainter::Antialiasing, true);
 
@@ -61,10 +152,25 @@ protected:
         painter.translate(m_centerPoint + m_centerOffset);
         painter.scale(m_zoomRate, m_zoomRate);
 
+        const QPointF posePx(m_pose.x * m_pixelsPerMeter, m_pose.y * m_pixelsPerMeter);
+        if (m_followPose)
+            painter.translate(-posePx);
+        drawMap(painter);
+
+        // Sensor frame
+        painter.translate(posePx);
+        painter.rotate(qRadiansToDegrees(m_pose.theta));
         drawCrosshair(painter);
         drawConcCircles(painter);
-        drawLidarPoints(painter);
-
+        drawZones(painter);
+        if (m_lineMode)
+            drawSegments(painter);
+        else
+            drawLidarPoints(painter);
+        drawChanges(painter);
+        drawClusters(painter);
+        drawOverlay(painter);
+        emit painted();
     }
     void mousePressEvent(QMouseEvent *event) override
     {
@@ -99,22 +205,190 @@ protected:
     }
 
 private:
+    template <class T>
+    static void assign(QVector<T> &dst, const T *src, int count)
+    {
+        dst.resize(count);
+        std::copy(src, src + count, dst.begin());
+    }
+
+    // Draws the visible map tiles from cached images. A tile image is rebuilt
+    // only when the tile version differs from the cached one. The pyramid
+    // level follows m_zoomRate so roughly one map cell lands on each pixel.
+    void drawMap(QPainter &painter)
+    {
+        if (!m_map)
+            return;
+        QMutexLocker mapLocker(m_map->mutex());
+        const int level = COccupancyGrid::levelFor(m_map->cellSize() * m_pixelsPerMeter * m_zoomRate);
+        int tx0, ty0, tx1, ty1;
+        if (!m_map->tileBounds(tx0, ty0, tx1, ty1, level))
+            return;
+
+        const double span = m_map->tileSpan(level) * m_pixelsPerMeter;
+        const QRectF view = painter.worldTransform().inverted().mapRect(QRectF(rect()));
+        tx0 = qMax(tx0, int(std::floor(view.left() / span)));
+        ty0 = qMax(ty0, int(std::floor(view.top() / span)));
+        tx1 = qMin(tx1, int(std::floor(view.right() / span)));
+        ty1 = qMin(ty1, int(std::floor(view.bottom() / span)));
+
+        painter.save();
+        painter.setRenderHint(QPainter::Antialiasing, false);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        m_mapFrame++;
+        int drawn = 0;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                const COccupancyGrid::Tile *tile = m_map->tile(tx, ty, level);
+                if (!tile)
+                    continue;
+                painter.drawImage(QRectF(tx * span, ty * span, span, span), tileImage(tile));
+                drawn++;
+            }
+        }
+        painter.restore();
+
+        // Keep cached images close to what is on screen.
+        QHash<quint64, TileImage> &cache = m_tileCache[level];
+        if (cache.size() > 2 * drawn + 64) {
+            for (auto it = cache.begin(); it != cache.end();) {
+                if (it.value().frame != m_mapFrame)
+                    it = cache.erase(it);
+                else
+                    ++it;
+            }
+        }
+        for (int i = 0; i < COccupancyGrid::LevelCount; i++) {
+            if (i != level)
+                m_tileCache[i].clear();
+        }
+    }
+    const QImage &tileImage(const COccupancyGrid::Tile *tile)
+    {
+        TileImage &cached = m_tileCache[tile->level][COccupancyGrid::tileKey(tile->tx, tile->ty)];
+        cached.frame = m_mapFrame;
+        if (cached.image.isNull()) {
+            cached.image = QImage(COccupancyGrid::TileSize, COccupancyGrid::TileSize, QImage::Format_ARGB32);
+        }
+        else if (cached.version == tile->version) {
+            return cached.image;
+        }
+
+        for (int y = 0; y < COccupancyGrid::TileSize; y++) {
+            QRgb *line = reinterpret_cast<QRgb *>(cached.image.scanLine(y));
+            const qint8 *cells = tile->cells + y * COccupancyGrid::TileSize;
+            for (int x = 0; x < COccupancyGrid::TileSize; x++)
+                line[x] = m_mapPalette[quint8(cells[x])];
+        }
+        cached.version = tile->version;
+        return cached.image;
+    }
     void drawLidarPoints(QPainter &painter)
     {
+        if (m_fused.sensors.size() > 1) {
+            drawFusedPoints(painter);
+            return;
+        }
         painter.setPen(QPen(Qt::green, m_PointSize / m_zoomRate));
 
         for (const QPointF &point : qAsConst(m_lidarPoints)) {
             painter.drawPoint(point);
         }
     }
+    void drawSegments(QPainter &painter)
+    {
+        painter.save();
+        painter.scale(m_pixelsPerMeter, m_pixelsPerMeter);
+        painter.setPen(QPen(Qt::green, m_PointSize / (m_pixelsPerMeter * m_zoomRate)));
+        for (const CLineExtractor::Segment &segment : qAsConst(m_segments))
+            painter.drawLine(segment.a, segment.b);
+        painter.restore();
+    }
+    // One hue per sensor, sensor 0 keeps the usual green.
+    void drawFusedPoints(QPainter &painter)
+    {
+        painter.save();
+        painter.scale(m_pixelsPerMeter, m_pixelsPerMeter);
+        for (int i = 0; i < m_fused.sensors.size(); i++) {
+            const QColor color = QColor::fromHsv((120 + m_fused.sensors[i] * 67) % 360, 255, 255);
+            painter.setPen(QPen(color, m_PointSize / (m_pixelsPerMeter * m_zoomRate)));
+            const int first = m_fused.offsets[i];
+            painter.drawPoints(m_fused.points.constData() + first, m_fused.offsets[i + 1] - first);
+        }
+        painter.restore();
+    }
+    // Zone outlines; a violated zone is filled.
+    void drawZones(QPainter &painter)
+    {
+        if (!m_zones)
+            return;
+        const QVector<CSafetyZones::Zone> zones = m_zones->zones();
+        if (zones.isEmpty())
+            return;
+        painter.save();
+        painter.scale(m_pixelsPerMeter, m_pixelsPerMeter);
+        const double px = 1.0 / (m_pixelsPerMeter * m_zoomRate);
+        for (const CSafetyZones::Zone &zone : zones) {
+            QColor color = zone.type == CSafetyZones::eZoneType::protective ? QColor(Qt::red) : QColor(Qt::yellow);
+            painter.setPen(QPen(color, 2 * px));
+            color.setAlpha(zone.violated ? 96 : 0);
+            painter.setBrush(color);
+            painter.drawPolygon(zone.polygon.constData(), zone.polygon.size());
+        }
+        painter.restore();
+    }
+    void drawChanges(QPainter &painter)
+    {
+        if (m_changes.isEmpty())
+            return;
+        painter.save();
+        painter.scale(m_pixelsPerMeter, m_pixelsPerMeter);
+        painter.setPen(QPen(Qt::red, 2 * m_PointSize / (m_pixelsPerMeter * m_zoomRate)));
+        painter.drawPoints(m_changes.constData(), m_changes.size());
+        painter.restore();
+    }
+    // Cluster boxes and centroids, in meters in the sensor frame.
+    void drawClusters(QPainter &painter)
+    {
+        if (m_clusters.isEmpty())
+            return;
+        painter.save();
+        painter.scale(m_pixelsPerMeter, m_pixelsPerMeter);
+        const double px = 1.0 / (m_pixelsPerMeter * m_zoomRate);
+        painter.setPen(QPen(Qt::cyan, px));
+        painter.setBrush(Qt::NoBrush);
+        const double mark = 4.0 * px;
+        for (const CScanSegmenter::Cluster &cluster : qAsConst(m_clusters)) {
+            painter.drawRect(cluster.bounds);
+            painter.drawLine(cluster.centroid - QPointF(mark, 0), cluster.centroid + QPointF(mark, 0));
+            painter.drawLine(cluster.centroid - QPointF(0, mark), cluster.centroid + QPointF(0, mark));
+        }
+        painter.restore();
+    }
     void drawCrosshair(QPainter &painter)
     {
         painter.setPen(penGrid);
-        m_lidarPos = (m_centerPoint + m_centerOffset) / m_zoomRate;
+        const QRectF view = painter.worldTransform().inverted().mapRect(QRectF(rect()));
         m_sceneSize = QPointF(width() / m_zoomRate, height() / m_zoomRate);
 
-        painter.drawLine(-m_lidarPos.rx(), 0, m_sceneSize.rx() - m_lidarPos.rx(), 0);
-        painter.drawLine(0, -m_lidarPos.ry(), 0, m_sceneSize.ry() - m_lidarPos.ry());
+        painter.drawLine(QPointF(view.left(), 0), QPointF(view.right(), 0));
+        painter.drawLine(QPointF(0, view.top()), QPointF(0, view.bottom()));
+    }
+    void drawOverlay(QPainter &painter)
+    {
+        if (m_overlay.isEmpty())
+            return;
+        painter.resetTransform();
+        painter.setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        const QFontMetrics metrics = painter.fontMetrics();
+        int width = 0;
+        for (const QString &line : m_overlay)
+            width = qMax(width, metrics.horizontalAdvance(line));
+        const QRect box(8, 8, width + 12, m_overlay.size() * metrics.height() + 8);
+        painter.fillRect(box, QColor(0, 0, 0, 160));
+        painter.setPen(Qt::white);
+        for (int i = 0; i < m_overlay.size(); i++)
+            painter.drawText(box.left() + 6, box.top() + 4 + metrics.ascent() + i * metrics.height(), m_overlay[i]);
     }
     void drawConcCircles(QPainter &painter)
     {
@@ -134,8 +408,16 @@ private:
     }
 
     QPointF m_sceneSize;
-    QPointF m_lidarPos;
+    CPose2D m_pose;
+    bool    m_followPose = true;
     QVector<QPointF> m_lidarPoints;
+    QVector<CScanSegmenter::Cluster> m_clusters;
+    QVector<CLineExtractor::Segment> m_segments;
+    QVector<QPointF> m_changes;
+    const CSafetyZones *m_zones = nullptr;
+    CScanFusion::Frame m_fused;
+    bool    m_lineMode = false;
+    QStringList m_overlay;
     QPointF m_centerOffset;
     QPointF m_centerPoint;
     QPoint  m_lastMousePos;
@@ -158,4 +440,14 @@ private:
     QPen penThick;
     QPen penGrid;
 
+    struct TileImage {
+        QImage image;
+        quint32 version = 0;
+        quint32 frame = 0;
+    };
+    const COccupancyGrid *m_map = nullptr;
+    QHash<quint64, TileImage> m_tileCache[COccupancyGrid::LevelCount];
+    QRgb m_mapPalette[256];
+    quint32 m_mapFrame = 0;
+
 };
@@ -1,21 +1,21 @@
 QT += network
 QT += core widgets gui
-QT += concurrent
+QT += serialport
 
 # install
  INSTALLS += widget
 
 HEADERS += \
-    CCloudPoints.h \
+    CSensorPanel.h \
+    CMetricsPanel.h \
     CLumoMap.h \
-    CComm.h \
     CMainWin.h
 
 SOURCES += \
            CLumoMap.cpp \
-           CComm.cpp \
            CMainWin.cpp \
            main.cpp
+include(core/LumoCore.pri)
 FORMS +=
-QMAKE_CXXFLAGS += /utf-8
+msvc: QMAKE_CXXFLAGS += /utf-8
 CONFIG += c++11
@@ -24,23 +24,45 @@
 #include <QMenuBar>
 #include <QStatusBar>
 #include <QTimer>
+#include <QDir>
+#include <QStandardPaths>
 
 #include "CLumoMap.h"
 #include "CCloudPoints.h"
 #include "CComm.h"
+#include "CScanServer.h"
+#include "CSafetyZones.h"
+#include "CSensorPanel.h"
+#include "CIngest.h"
+#include "CDecoderRegistry.h"
+#include "CMetricsPanel.h"
 #include <QtCore/QObject>
 
 class CMainWin : public QMainWindow {
     Q_OBJECT
 
 public:
-    CMainWin(QWidget *parent = nullptr) : QMainWindow(parent), cloudPoints(new CCloudPoints(this)), lumoMap(new CLumoMap(this)) {
+    CMainWin(QWidget *parent = nullptr) : QMainWindow(parent), cloudPoints(new CCloudPoints(this)), lumoMap(new CLumoMap(this)), scanServer(new CScanServer(this)), safetyZones(new CSafetyZones(this)) {
         setCentralWidget(lumoMap);
+        ingest = new CIngest(scanServer, safetyZones, this);
+        openMapStore();
+        lumoMap->setMap(&ingest->grid());
+        lumoMap->setZones(safetyZones);
+        sensorPanel = new CSensorPanel(this);
+        sensorPanel->setMetrics(&metrics);
+        addDockWidget(Qt::BottomDockWidgetArea, sensorPanel);
+        sensorPanel->hide();
+        metricsPanel = new CMetricsPanel(&metrics, this);
+        addDockWidget(Qt::RightDockWidgetArea, metricsPanel);
+        metricsPanel->hide();
         setUI();
+        setPipeline();
+        loadZones(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/zones.json");
         // 데이터 갱신 타이머
         QObject::connect(&coolTimer, &QTimer::timeout, this, &CMainWin::updatePoints);
     }
     ~CMainWin() {
+        ingest->close();
         if (comm)
             comm->close();
     }
@@ -48,12 +70,13 @@ public:
 public slots:
     void updatePoints() {
         if (comm->isIdle() && comm->inbox()) {
-            comm->recv(buff, msgWaitFor, true);
+            if (comm->recv(buff, msgWaitFor))
+                pushScan();
         }
         else // Drawing Data Test
         {
             cloudPoints->generateVirtualData();
-            lumoMap->lumos(cloudPoints->getPoints());
+            lumoMap->lumos(*cloudPoints);
         }
     }
 
@@ -68,10 +91,13 @@ public slots:
 
         switch(status) {
         case Comm::eStatus::connected:
+            ingest->reconnected();
             connStatus->setText("Connected");
             if (!btnConnect->isChecked())
                 btnConnect->setChecked(true);
             chkCommType->setEnabled(false);
+            if (!coolTimer.isActive())
+                coolTimer.start(100); // 100ms마다 화면 갱신
         case Comm::eStatus::ready:
             connStatus->setStyleSheet("color: white; background-color: Green; padding: 2px;");
             break;
@@ -82,15 +108,14 @@ public slots:
         case Comm::eStatus::sent:
             buff.clear();
             break;
-        case Comm::eStatus::recved:
-            afterRecved();
-            QtConcurrent::run([&]() {
-                lumoMap->lumos(cloudPoints->getPoints());
-            });
-            break;
         case Comm::eStatus::connFailed:
         case Comm::eStatus::connLost:
             onAlert(nullptr, 0, "Connection Error");
+            if (sender && sender->isReconnecting()) {
+                connStatus->setStyleSheet("color: black; background-color: orange; padding: 2px;");
+                connStatus->setText("Retrying");
+                break;
+            }
         case Comm::eStatus::closed:
             connStatus->setStyleSheet("color: white; background-color: darkRed; padding: 2px;");
             connStatus->setText("Disconnected");
@@ -133,40 +158,123 @@ public slots:
 
 private:
     QByteArray buff;
+    CIngest *ingest;
+    bool changeAlerted = false;
+    const int changeAlertPoints = 5;
+    CLatency::Stamps paintTimes;    // last rendered scan, until painted
+    bool paintPending = false;
+    bool showLatency = false;
 
     CCloudPoints *cloudPoints;
     CLumoMap *lumoMap;
+    CScanServer *scanServer;
+    CSafetyZones *safetyZones;
+    CSensorPanel *sensorPanel;
+    CMetricsPanel *metricsPanel;
+    CMetrics metrics;
+    CScanFusion fusion;
     QLabel *statusIndicator;
     QTimer coolTimer, msgTimer;
 
-    QLabel *connStatus, *commAlert;
+    QLabel *connStatus, *commAlert, *zoneLatency, *pipelineStatus;
+    QTimer pipelineTimer;
+    const int pipelineStatsInterval = 1000;
     QString ipAddress;
     int port;
     enum class eCommType { None, TCP, UDP, COM };
     eCommType m_commType = eCommType::TCP;
     QLineEdit *connString;
     QLineEdit *connNum;
+    QIntValidator *portValidator;
+    QIntValidator *baudValidator;
     QPushButton *btnConnect;
+    QComboBox *sensorModel;
+    QLineEdit *servePort;
+    QPushButton *btnServe;
+    QComboBox *serveFormat;
     QAction *chkTCP;
     QAction *chkUDP;
     QAction *chkSerial;
     QActionGroup *chkCommType;
     Comm *comm = nullptr;
     const quint32 commWaitFor = 1000;
+    const int connCheckInterval = 200;
     const quint32 msgWaitFor = 5000;
 
-    void afterRecved() {
-        float lidarFactor[2] = { 0 };
-        int cnt = comm->bytesRecv();
-        QDataStream in(&buff, QIODevice::ReadOnly);
-        //in.setByteOrder(QDataStream::LittleEndian);
-        in.setFloatingPointPrecision(QDataStream::SinglePrecision);
-        while(!in.atEnd())
-        {
-            in >> lidarFactor[0] >> lidarFactor[1];
-            cloudPoints->setPoint(lidarFactor[0], lidarFactor[1]);
+    void setPipeline() {
+        QObject::connect(ingest, &CIngest::scanReady, this, &CMainWin::render);
+        metrics.addSource(ingest->metricsSource(0, "Main"));
+
+        QObject::connect(&pipelineTimer, &QTimer::timeout, this, &CMainWin::updatePipelineStatus);
+        pipelineTimer.start(pipelineStatsInterval);
+    }
+
+    void pushScan() {
+        ingest->push(buff, comm->arrivalStamp(), comm->recvStamp());
+    }
+
+    void render(const CScanJob &job) {
+        LUMO_TRACE("render");
+        cloudPoints->setScan(job.scan);
+        if (!safetyZones->zones().isEmpty()) {
+            zoneLatency->setText(QString("Zones %1 / %2 ms")
+                                 .arg(safetyZones->lastLatency() / 1000.0, 0, 'f', 2)
+                                 .arg(safetyZones->maxLatency() / 1000.0, 0, 'f', 2));
         }
-        buff.clear();
+        lumoMap->setClusters(job.clusters, job.clusterCount);
+        lumoMap->setSegments(job.segments, job.segmentCount);
+        lumoMap->setChanges(job.changes, job.changeCount);
+        lumoMap->setPose(job.pose);
+        fusion.add(job.sensor, job.stamp, job.points, job.pointCount);
+        lumoMap->setFusion(fusion.fuse());
+        lumoMap->lumos(*cloudPoints);
+        paintTimes = job.times;
+        paintPending = true;
+
+        if (job.changed >= changeAlertPoints && !changeAlerted)
+            onAlert(nullptr, 0, "Change detected: " + QString::number(job.changed) + " beams");
+        changeAlerted = job.changed >= changeAlertPoints;
+    }
+
+    void updatePipelineStatus() {
+        QStringList depths, tips;
+        for (const auto &stage : ingest->pipeline().stats(true)) {
+            depths << QString::number(stage.depth);
+            tips << QString("%1: %2 / %3 ms, %4 dropped")
+                    .arg(stage.name)
+                    .arg(stage.meanMs, 0, 'f', 2)
+                    .arg(stage.maxMs, 0, 'f', 2)
+                    .arg(stage.dropped);
+        }
+        pipelineStatus->setText("Queue " + depths.join('/'));
+        pipelineStatus->setToolTip(tips.join('\n'));
+
+        QStringList lines;
+        for (const CLatency::SegmentStats &segment : ingest->latency().stats(true)) {
+            lines << QString("%1 %2 / %3 / %4 ms")
+                     .arg(segment.name, -8)
+                     .arg(segment.p50Ms, 0, 'f', 2)
+                     .arg(segment.p99Ms, 0, 'f', 2)
+                     .arg(segment.maxMs, 0, 'f', 2);
+        }
+        if (showLatency)
+            lumoMap->setOverlay(QStringList("p50 / p99 / max") + lines);
+    }
+
+    // 맵 파일은 시작 시 인덱스만 읽고, 타일은 화면 이동에 따라 필요할 때 로드됨
+    void openMapStore() {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(dir);
+        ingest->openMap(dir + "/LumoMap.lmap");
+    }
+
+    bool loadZones(const QString &path) {
+        if (!safetyZones->load(path))
+            return false;
+        safetyZones->resetLatency();
+        zoneLatency->setVisible(!safetyZones->zones().isEmpty());
+        lumoMap->update();
+        return true;
     }
 
     bool setCommType() {
@@ -188,7 +296,7 @@ private:
         }
         else if (chkSerial->isChecked()) {
             m_commType = eCommType::COM;
-            //comm = new SerialComm(this);
+            comm = new SerialComm(this);
         }
         QObject::connect(comm, &Comm::onStatus, this, &CMainWin::onStatus);
         QObject::connect(comm, &Comm::onAlert, this, &CMainWin::onAlert);
@@ -196,14 +304,42 @@ private:
         return true;
     }
 
+    // COM uses the same two fields as port name and baud rate.
+    void setConnFields() {
+        bool isSerial = chkSerial->isChecked();
+        if (isSerial == (connNum->validator() == baudValidator))
+            return;
+
+        if (isSerial) {
+            connString->setPlaceholderText("Enter Port Name");
+            connString->setText("/dev/ttyUSB0");
+            connNum->setPlaceholderText("Enter Baud Rate");
+            connNum->setValidator(baudValidator);
+            connNum->setText("921600");
+        }
+        else {
+            connString->setPlaceholderText("Enter IP Address");
+            connString->setText("127.0.0.1");
+            connNum->setPlaceholderText("Enter Port Number");
+            connNum->setValidator(portValidator);
+            connNum->setText("45454");
+        }
+    }
+
     void toggleConn() {
        if (btnConnect->isChecked()) {
             if (!comm)
                 setCommType();
             if (!comm->checkConn()) {
+                std::shared_ptr<CDecoder> decoder = CDecoderRegistry::create(sensorModel->currentData().toString());
+                const CDecoder::Layout layout = decoder->layout();
+                ingest->setDecoder(decoder);
+                cloudPoints->setLayout(layout.beams, layout.resolution);
+                sensorModel->setEnabled(false);
                 comm->setConnInfo(connString->text(), connNum->text().toInt());
-                if (comm->connect(commWaitFor))
-                    coolTimer.start(100); // 100ms마다 화면 갱신
+                comm->setTimeout(true, connCheckInterval, true, false, false);
+                comm->setReconnect(true);
+                comm->connect(commWaitFor);
             }
         }
         else {
@@ -215,6 +351,25 @@ private:
                 comm->deleteLater();
                 comm = nullptr;
             }
+            ingest->setDecoder(nullptr);
+            sensorModel->setEnabled(true);
+        }
+    }
+
+    void toggleServe() {
+        if (btnServe->isChecked()) {
+            if (scanServer->start((quint16)servePort->text().toUInt())) {
+                servePort->setEnabled(false);
+                onAlert(nullptr, 0, "Serving on port " + servePort->text());
+            }
+            else {
+                onAlert(nullptr, 0, "Serving Failed.");
+                btnServe->setChecked(false);
+            }
+        }
+        else {
+            scanServer->stop();
+            servePort->setEnabled(true);
         }
     }
 
@@ -246,6 +401,7 @@ private:
         // QObject::connect(chkTCP, &QAction::triggered, this, &CMainWin::setCommType);
         // QObject::connect(chkUDP, &QAction::triggered, this, &CMainWin::setCommType);
         // QObject::connect(chkSerial, &QAction::triggered, this, &CMainWin::setCommType);
+        QObject::connect(chkCommType, &QActionGroup::triggered, this, &CMainWin::setConnFields);
 
         // 툴바: IP 주소 및 포트 번호 입력란 추가
         connString = new QLineEdit("127.0.0.1", this);
@@ -258,9 +414,18 @@ private:
         connNum->setFixedWidth(100);
         connNum->setAlignment(Qt::AlignCenter);
         connNum->setPlaceholderText("Enter Port Number");
-        connNum->setValidator(new QIntValidator(0, 65535, this));
+        portValidator = new QIntValidator(0, 65535, this);
+        baudValidator = new QIntValidator(1, 16000000, this);
+        connNum->setValidator(portValidator);
         toolBar->addWidget(connNum);
 
+        // 툴바: 센서 모델(패킷 형식) 선택 콤보박스 추가
+        sensorModel = new QComboBox(this);
+        for (const CDecoderRegistry::Entry &entry : CDecoderRegistry::entries())
+            sensorModel->addItem(entry.title, entry.model);
+        sensorModel->setCurrentIndex(sensorModel->findData(CDecoderRegistry::defaultModel()));
+        toolBar->addWidget(sensorModel);
+
         // 툴바: 통신 연결/종료 토글 버튼 추가
         btnConnect = new QPushButton("Connect", this);
         btnConnect->setCheckable(true);
@@ -268,6 +433,108 @@ private:
         toolBar->addWidget(btnConnect);
         QObject::connect(btnConnect, &QPushButton::toggled, this, &CMainWin::toggleConn);
 
+        // 툴바: 재전송 서버 포트 입력란 및 토글 버튼 추가
+        toolBar->addSeparator();
+        servePort = new QLineEdit("45455", this);
+        servePort->setFixedWidth(100);
+        servePort->setAlignment(Qt::AlignCenter);
+        servePort->setPlaceholderText("Enter Serve Port");
+        servePort->setValidator(new QIntValidator(1, 65535, this));
+        toolBar->addWidget(servePort);
+
+        serveFormat = new QComboBox(this);
+        serveFormat->addItem("Raw", int(CScanServer::eFormat::raw));
+        serveFormat->addItem("Compact", int(CScanServer::eFormat::compact));
+        serveFormat->addItem("Lines", int(CScanServer::eFormat::lines));
+        toolBar->addWidget(serveFormat);
+        QObject::connect(serveFormat, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [&]() {
+            scanServer->setFormat(CScanServer::eFormat(serveFormat->currentData().toInt()));
+        });
+
+        btnServe = new QPushButton("Serve", this);
+        btnServe->setCheckable(true);
+        btnServe->setChecked(false);
+        toolBar->addWidget(btnServe);
+        QObject::connect(btnServe, &QPushButton::toggled, this, &CMainWin::toggleServe);
+        QObject::connect(scanServer, &CScanServer::onClients, this, [&](int count) {
+            onAlert(nullptr, 0, "Clients: " + QString::number(count));
+        });
+
+        // 툴바: 점 대신 추출된 선분 표시
+        toolBar->addSeparator();
+        QAction *chkLines = toolBar->addAction("Lines");
+        chkLines->setCheckable(true);
+        QObject::connect(chkLines, &QAction::toggled, lumoMap, &CLumoMap::setLineMode);
+
+        // 툴바: 안전 영역 파일 불러오기
+        QAction *actZones = toolBar->addAction("Zones...");
+        QObject::connect(actZones, &QAction::triggered, this, [&]() {
+            QString path = QFileDialog::getOpenFileName(this, "Load Zones", QString(), "Zones (*.json)");
+            if (!path.isEmpty() && !loadZones(path))
+                onAlert(nullptr, 0, "Loading Zones Failed.");
+        });
+        QObject::connect(safetyZones, &CSafetyZones::onAlert, this, [&](CSafetyZones *, int alertCode, const QString msg) {
+            onAlert(nullptr, alertCode, msg);
+        });
+
+        // 툴바: 추가 센서 패널 표시
+        toolBar->addAction(sensorPanel->toggleViewAction());
+        QObject::connect(sensorPanel, &CSensorPanel::scanReady, this, [&](const CScanFusion::Scan &scan) {
+            fusion.add(scan);
+            lumoMap->setFusion(fusion.fuse());
+        });
+        QObject::connect(sensorPanel, &CSensorPanel::sensorRemoved, this, [&](int id) {
+            fusion.remove(id);
+            lumoMap->setFusion(fusion.fuse());
+        });
+        QObject::connect(sensorPanel, &CSensorPanel::onAlert, this, [&](CSensor *, int alertCode, const QString msg) {
+            onAlert(nullptr, alertCode, msg);
+        });
+
+        // 툴바: 노이즈 필터 사용 여부 (기본 사용)
+        QAction *chkFilter = toolBar->addAction("Filter");
+        chkFilter->setCheckable(true);
+        chkFilter->setChecked(true);
+        QObject::connect(chkFilter, &QAction::toggled, this, [&](bool enabled) {
+            CScanFilter::Options options = ingest->filter().options();
+            options.enabled = enabled;
+            ingest->filter().setOptions(options);
+        });
+
+        // 툴바: 구간별 지연 시간 오버레이 표시
+        QAction *chkLatency = toolBar->addAction("Latency");
+        chkLatency->setCheckable(true);
+        QObject::connect(chkLatency, &QAction::toggled, this, [&](bool enabled) {
+            showLatency = enabled;
+            lumoMap->setOverlay(QStringList());
+        });
+        QObject::connect(lumoMap, &CLumoMap::painted, this, [&]() {
+            if (paintPending) {
+                ingest->latency().painted(paintTimes, CClock::nsecs());
+                paintPending = false;
+            }
+            metrics.frame();
+        });
+
+        // 툴바: 트레이스 기록 시작/종료 (종료 시 Chrome 트레이스 파일로 저장)
+        QAction *chkTrace = toolBar->addAction("Trace");
+        chkTrace->setCheckable(true);
+        QObject::connect(chkTrace, &QAction::toggled, this, [&](bool enabled) {
+            CTrace::setEnabled(enabled);
+            if (enabled)
+                return;
+            QString path = QFileDialog::getSaveFileName(this, "Save Trace", "trace.json", "Trace (*.json)");
+            if (path.isEmpty())
+                return;
+            onAlert(nullptr, 0, CTrace::dump(path) ? "Trace saved to " + path : "Saving Trace Failed.");
+        });
+
+        // 툴바: 처리량/상태 메트릭 패널 표시
+        toolBar->addAction(metricsPanel->toggleViewAction());
+        QObject::connect(metricsPanel, &CMetricsPanel::onAlert, this, [&](const QString msg) {
+            onAlert(nullptr, 0, msg);
+        });
+
         // 상태표시줄-통신 설정
         QStatusBar *statusBar = new QStatusBar(this);
         setStatusBar(statusBar);
@@ -276,6 +543,13 @@ private:
         connStatus->setFixedWidth(100);
         connStatus->setAlignment(Qt::AlignCenter);
         statusBar->addPermanentWidget(connStatus);
+        // 상태표시줄: 수신부터 안전 영역 판정까지의 지연 (마지막 / 최대)
+        zoneLatency = new QLabel(this);
+        zoneLatency->setVisible(false);
+        statusBar->addPermanentWidget(zoneLatency);
+        // 파이프라인 단계별 대기열 (툴팁: 평균/최대 지연)
+        pipelineStatus = new QLabel(this);
+        statusBar->addPermanentWidget(pipelineStatus);
 
         // 상태표시줄: alert을 확장하여 표시하는 QLabel 위젯 추가
         commAlert = new QLabel(this);
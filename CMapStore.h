@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMAPSTORE_H
+#define CMAPSTORE_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <cstring>
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#endif
+
+// Memory-mapped tile file backing COccupancyGrid.
+//
+// Layout (all offsets page aligned):
+//   [header page]
+//   [chunk 0: index page (ChunkTiles entries) | ChunkTiles tile slots] ...
+// Opening a file maps the chunks and reads only their index pages, so it
+// costs one page per ChunkTiles tiles no matter how large the map is. Tile
+// data is paged in by the OS when it is first read and written back by the
+// kernel; sync() only requests writeback.
+class CMapStore {
+public:
+    static constexpr int PageSize = 4096;
+    static constexpr int ChunkTiles = 256;
+    static constexpr quint32 FormatVersion = 1;
+
+    struct Header {
+        char magic[8];
+        quint32 formatVersion;
+        quint32 slotSize;
+        float cellSize;
+        quint32 levelCount;
+        quint32 chunkTiles;
+        quint32 chunkCount;
+        quint32 tileCount;
+        quint32 mapVersion;
+    };
+
+    struct Entry {
+        qint32 tx;
+        qint32 ty;
+        qint32 level;
+        quint32 used;
+    };
+
+    CMapStore() {}
+    ~CMapStore() {
+        close();
+    }
+    Q_DISABLE_COPY(CMapStore)
+
+    // Opens path, creating it when missing. An existing file must have been
+    // written with the same slot size, cell size and level count.
+    bool open(const QString &path, int slotSize, float cellSize, int levelCount) {
+        close();
+        m_file.setFileName(path);
+        const bool exists = m_file.exists() && m_file.size() >= PageSize;
+        if (!m_file.open(QIODevice::ReadWrite))
+            return false;
+        if (!exists && !m_file.resize(PageSize)) {
+            m_file.close();
+            return false;
+        }
+
+        m_header = reinterpret_cast<Header *>(m_file.map(0, PageSize));
+        if (!m_header) {
+            m_file.close();
+            return false;
+        }
+
+        if (!exists) {
+            memset(m_header, 0, sizeof(Header));
+            memcpy(m_header->magic, "LUMOMAP", 8);
+            m_header->formatVersion = FormatVersion;
+            m_header->slotSize = quint32(slotSize);
+            m_header->cellSize = cellSize;
+            m_header->levelCount = quint32(levelCount);
+            m_header->chunkTiles = ChunkTiles;
+        }
+        else if (memcmp(m_header->magic, "LUMOMAP", 8) != 0 ||
+                 m_header->formatVersion != FormatVersion ||
+                 m_header->slotSize != quint32(slotSize) ||
+                 m_header->cellSize != cellSize ||
+                 m_header->levelCount != quint32(levelCount) ||
+                 m_header->chunkTiles != quint32(ChunkTiles)) {
+            close();
+            return false;
+        }
+
+        m_chunkBytes = (PageSize + qint64(ChunkTiles) * slotSize + PageSize - 1) / PageSize * PageSize;
+        m_slotSize = slotSize;
+        m_index.resize(levelCount);
+        m_bounds.resize(levelCount);
+
+        for (quint32 chunk = 0; chunk < m_header->chunkCount; chunk++) {
+            if (!mapChunk(chunk)) {
+                close();
+                return false;
+            }
+        }
+        for (quint32 slot = 0; slot < m_header->tileCount; slot++) {
+            const Entry &entry = this->entry(int(slot));
+            if (entry.used && entry.level >= 0 && entry.level < levelCount)
+                addIndex(entry.level, entry.tx, entry.ty, int(slot));
+        }
+        return true;
+    }
+
+    void close() {
+        if (!m_file.isOpen())
+            return;
+        sync(true);
+        for (uchar *chunk : qAsConst(m_chunks))
+            m_file.unmap(chunk);
+        if (m_header)
+            m_file.unmap(reinterpret_cast<uchar *>(m_header));
+        m_chunks.clear();
+        m_index.clear();
+        m_bounds.clear();
+        m_header = nullptr;
+        m_file.close();
+    }
+
+    bool isOpen() const {
+        return m_header != nullptr;
+    }
+
+    const void *find(int level, int tx, int ty) const {
+        if (!m_header)
+            return nullptr;
+        const int slot = m_index[level].value(key(tx, ty), -1);
+        return slot < 0 ? nullptr : slotData(slot);
+    }
+
+    // Returns the slot for a tile, allocating one (and growing the file by a
+    // chunk when full) if the tile is not stored yet.
+    void *insert(int level, int tx, int ty) {
+        if (!m_header)
+            return nullptr;
+        int slot = m_index[level].value(key(tx, ty), -1);
+        if (slot >= 0)
+            return slotData(slot);
+
+        slot = int(m_header->tileCount);
+        const quint32 chunk = quint32(slot / ChunkTiles);
+        if (chunk == m_header->chunkCount) {
+            if (!m_file.resize(PageSize + qint64(chunk + 1) * m_chunkBytes) || !mapChunk(chunk))
+                return nullptr;
+            m_header->chunkCount = chunk + 1;
+        }
+
+        Entry &entry = this->entry(slot);
+        entry.tx = tx;
+        entry.ty = ty;
+        entry.level = level;
+        entry.used = 1;
+        m_header->tileCount = quint32(slot + 1);
+        addIndex(level, tx, ty, slot);
+        return slotData(slot);
+    }
+
+    bool bounds(int level, int &tx0, int &ty0, int &tx1, int &ty1) const {
+        if (!m_header || !m_bounds[level].valid)
+            return false;
+        const Bounds &b = m_bounds[level];
+        tx0 = b.tx0; ty0 = b.ty0;
+        tx1 = b.tx1; ty1 = b.ty1;
+        return true;
+    }
+
+    // Requests writeback of dirty pages; blocks only when wait is set.
+    void sync(bool wait = false) {
+#if defined(Q_OS_UNIX)
+        const int flags = wait ? MS_SYNC : MS_ASYNC;
+        if (m_header)
+            msync(m_header, PageSize, flags);
+        for (uchar *chunk : qAsConst(m_chunks))
+            msync(chunk, size_t(m_chunkBytes), flags);
+#else
+        Q_UNUSED(wait)
+#endif
+    }
+
+    quint32 mapVersion() const { return m_header ? m_header->mapVersion : 0; }
+    void setMapVersion(quint32 version) { if (m_header) m_header->mapVersion = version; }
+    int tileCount() const { return m_header ? int(m_header->tileCount) : 0; }
+    qint64 fileSize() const { return m_file.size(); }
+
+private:
+    struct Bounds {
+        bool valid = false;
+        int tx0 = 0, ty0 = 0, tx1 = 0, ty1 = 0;
+    };
+
+    QFile m_file;
+    Header *m_header = nullptr;
+    QVector<uchar *> m_chunks;
+    QVector<QHash<quint64, int>> m_index;
+    QVector<Bounds> m_bounds;
+    qint64 m_chunkBytes = 0;
+    int m_slotSize = 0;
+
+    static quint64 key(int tx, int ty) {
+        return (quint64(quint32(tx)) << 32) | quint32(ty);
+    }
+
+    bool mapChunk(quint32 chunk) {
+        uchar *data = m_file.map(PageSize + qint64(chunk) * m_chunkBytes, m_chunkBytes);
+        if (!data)
+            return false;
+        m_chunks.append(data);
+        return true;
+    }
+
+    Entry &entry(int slot) const {
+        return reinterpret_cast<Entry *>(m_chunks[slot / ChunkTiles])[slot % ChunkTiles];
+    }
+
+    uchar *slotData(int slot) const {
+        return m_chunks[slot / ChunkTiles] + PageSize + qint64(slot % ChunkTiles) * m_slotSize;
+    }
+
+    void addIndex(int level, int tx, int ty, int slot) {
+        m_index[level].insert(key(tx, ty), slot);
+        Bounds &b = m_bounds[level];
+        if (!b.valid) {
+            b.tx0 = b.tx1 = tx;
+            b.ty0 = b.ty1 = ty;
+            b.valid = true;
+        }
+        else {
+            b.tx0 = qMin(b.tx0, tx);
+            b.tx1 = qMax(b.tx1, tx);
+            b.ty0 = qMin(b.ty0, ty);
+            b.ty1 = qMax(b.ty1, ty);
+        }
+    }
+};
+
+#endif // CMAPSTORE_H
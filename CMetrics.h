@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMETRICS_H
+#define CMETRICS_H
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtNetwork/QLocalSocket>
+#include <atomic>
+#include <functional>
+
+// Running totals of one sensor connection. Bumped from whichever thread
+// does the work with relaxed atomic adds; nothing on the hot path locks.
+struct CMetricCounters {
+    std::atomic<quint64> bytes{0};
+    std::atomic<quint64> packets{0};        // receives
+    std::atomic<quint64> scans{0};          // completed revolutions
+    std::atomic<quint64> points{0};
+    // Receives that completed no record, e.g. a TCP segment holding part of
+    // one. Not an error: the decoder carries the bytes to the next receive.
+    std::atomic<quint64> partialReceives{0};
+
+    static void add(std::atomic<quint64> &counter, quint64 n = 1)
+    {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
+// Samples every registered source once per interval on the owner's
+// thread, turns totals into rates and hands the result to the panel and,
+// if set, an export target as one JSON object per line:
+//   a file path        appended to
+//   local:<name>       written to a QLocalSocket server, reconnected as needed
+class CMetrics : public QObject {
+    Q_OBJECT
+
+public:
+    // Dropped scans and queue depth are read from the source's pipeline
+    // when sampling, not counted per scan.
+    struct Source {
+        int id = 0;
+        QString name;
+        const CMetricCounters *counters = nullptr;
+        std::function<quint64()> dropped;
+        std::function<int()> depth;
+    };
+
+    struct SensorSample {
+        int id = 0;
+        QString name;
+        double bytesPerSec = 0.0;
+        double packetsPerSec = 0.0;
+        double scansPerSec = 0.0;
+        double pointsPerSec = 0.0;
+        quint64 partialReceives = 0;
+        quint64 dropped = 0;
+        int depth = 0;
+    };
+
+    struct Sample {
+        qint64 stamp = 0;           // msecs since epoch
+        double renderFps = 0.0;
+        QVector<SensorSample> sensors;
+    };
+
+    CMetrics(QObject *parent = nullptr, int interval = 1000)
+        : QObject(parent)
+    {
+        QObject::connect(&m_timer, &QTimer::timeout, this, &CMetrics::sample);
+        m_timer.start(interval);
+        m_clock.start();
+    }
+
+    void addSource(const Source &source)
+    {
+        removeSource(source.id);
+        m_sources.append(source);
+    }
+
+    void removeSource(int id)
+    {
+        for (int i = 0; i < m_sources.size(); i++) {
+            if (m_sources[i].id == id) {
+                m_sources.removeAt(i);
+                m_last.remove(id);
+                return;
+            }
+        }
+    }
+
+    // One finished paint of the view.
+    void frame()
+    {
+        m_frames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Empty stops exporting.
+    bool setExport(const QString &target)
+    {
+        m_file.close();
+        m_socket.abort();
+        m_target = target;
+        if (m_target.isEmpty())
+            return true;
+        if (m_target.startsWith(localPrefix)) {
+            m_socket.connectToServer(m_target.mid(localPrefix.size()));
+            return true;
+        }
+        m_file.setFileName(m_target);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+            m_target.clear();
+            return false;
+        }
+        return true;
+    }
+
+    QString exportTarget() const { return m_target; }
+
+    static QByteArray toJson(const Sample &sample)
+    {
+        QJsonArray sensors;
+        for (const SensorSample &s : sample.sensors) {
+            QJsonObject sensor;
+            sensor["id"] = s.id;
+            sensor["name"] = s.name;
+            sensor["bytes_per_s"] = s.bytesPerSec;
+            sensor["packets_per_s"] = s.packetsPerSec;
+            sensor["scans_per_s"] = s.scansPerSec;
+            sensor["points_per_s"] = s.pointsPerSec;
+            sensor["partial_receives"] = qint64(s.partialReceives);
+            sensor["dropped"] = qint64(s.dropped);
+            sensor["queue"] = s.depth;
+            sensors.append(sensor);
+        }
+        QJsonObject root;
+        root["t"] = sample.stamp;
+        root["render_fps"] = sample.renderFps;
+        root["sensors"] = sensors;
+        return QJsonDocument(root).toJson(QJsonDocument::Compact) + '\n';
+    }
+
+signals:
+    void sampled(const CMetrics::Sample &sample);
+
+private:
+    struct Totals {
+        quint64 bytes = 0, packets = 0, scans = 0, points = 0;
+    };
+
+    const QString localPrefix = "local:";
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    QVector<Source> m_sources;
+    QHash<int, Totals> m_last;
+    std::atomic<quint64> m_frames{0};
+    QString m_target;
+    QFile m_file;
+    QLocalSocket m_socket;
+
+    void sample()
+    {
+        const double seconds = qMax<qint64>(m_clock.restart(), 1) / 1000.0;
+        Sample s;
+        s.stamp = QDateTime::currentMSecsSinceEpoch();
+        s.renderFps = m_frames.exchange(0, std::memory_order_relaxed) / seconds;
+        for (const Source &source : m_sources) {
+            const CMetricCounters &c = *source.counters;
+            Totals now;
+            now.bytes = c.bytes.load(std::memory_order_relaxed);
+            now.packets = c.packets.load(std::memory_order_relaxed);
+            now.scans = c.scans.load(std::memory_order_relaxed);
+            now.points = c.points.load(std::memory_order_relaxed);
+            const Totals last = m_last.value(source.id, now);
+            m_last[source.id] = now;
+
+            SensorSample sensor;
+            sensor.id = source.id;
+            sensor.name = source.name;
+            sensor.bytesPerSec = (now.bytes - last.bytes) / seconds;
+            sensor.packetsPerSec = (now.packets - last.packets) / seconds;
+            sensor.scansPerSec = (now.scans - last.scans) / seconds;
+            sensor.pointsPerSec = (now.points - last.points) / seconds;
+            sensor.partialReceives = c.partialReceives.load(std::memory_order_relaxed);
+            sensor.dropped = source.dropped ? source.dropped() : 0;
+            sensor.depth = source.depth ? source.depth() : 0;
+            s.sensors.append(sensor);
+        }
+        emit sampled(s);
+        write(toJson(s));
+    }
+
+    void write(const QByteArray &line)
+    {
+        if (m_target.isEmpty())
+            return;
+        if (m_file.isOpen()) {
+            m_file.write(line);
+            m_file.flush();
+        }
+        else if (m_socket.state() == QLocalSocket::ConnectedState) {
+            m_socket.write(line);
+        }
+        else if (m_socket.state() == QLocalSocket::UnconnectedState) {
+            m_socket.connectToServer(m_target.mid(localPrefix.size()));
+        }
+    }
+};
+
+#endif // CMETRICS_H
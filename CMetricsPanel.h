@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMETRICSPANEL_H
+#define CMETRICSPANEL_H
+
+#include <QtWidgets>
+
+#include "CMetrics.h"
+
+// Dock showing the latest CMetrics sample, one row per sensor, and where
+// the samples are exported to.
+class CMetricsPanel : public QDockWidget {
+    Q_OBJECT
+
+public:
+    enum eColumn { colSensor = 0, colKBytes, colPackets, colScans, colPoints,
+                   colPartial, colDropped, colQueue, colCount };
+
+    CMetricsPanel(CMetrics *metrics, QWidget *parent = nullptr)
+        : QDockWidget("Metrics", parent), metrics(metrics)
+    {
+        QWidget *body = new QWidget(this);
+        QVBoxLayout *layout = new QVBoxLayout(body);
+        renderFps = new QLabel("Render - fps", body);
+        layout->addWidget(renderFps);
+        table = new QTableWidget(0, colCount, body);
+        table->setHorizontalHeaderLabels({"Sensor", "KB/s", "Packets/s", "Scans/s", "Points/s",
+                                          "Partial receives", "Dropped", "Queue"});
+        table->verticalHeader()->setVisible(false);
+        table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        layout->addWidget(table);
+
+        QHBoxLayout *exportRow = new QHBoxLayout();
+        exportTarget = new QLineEdit(body);
+        exportTarget->setPlaceholderText("File path or local:<server name>");
+        btnExport = new QPushButton("Export", body);
+        btnExport->setCheckable(true);
+        exportRow->addWidget(exportTarget);
+        exportRow->addWidget(btnExport);
+        layout->addLayout(exportRow);
+        setWidget(body);
+
+        QObject::connect(btnExport, &QPushButton::toggled, this, &CMetricsPanel::toggleExport);
+        QObject::connect(metrics, &CMetrics::sampled, this, &CMetricsPanel::showSample);
+    }
+
+signals:
+    void onAlert(const QString msg);
+
+private:
+    CMetrics *metrics;
+    QLabel *renderFps;
+    QTableWidget *table;
+    QLineEdit *exportTarget;
+    QPushButton *btnExport;
+
+    void toggleExport(bool on) {
+        if (!on) {
+            metrics->setExport(QString());
+            exportTarget->setEnabled(true);
+            return;
+        }
+        if (exportTarget->text().isEmpty() || !metrics->setExport(exportTarget->text())) {
+            const QSignalBlocker blocker(btnExport);
+            btnExport->setChecked(false);
+            emit onAlert("Metrics Export Failed.");
+            return;
+        }
+        exportTarget->setEnabled(false);
+    }
+
+    void showSample(const CMetrics::Sample &sample) {
+        if (!isVisible())
+            return;
+        renderFps->setText(QString("Render %1 fps").arg(sample.renderFps, 0, 'f', 1));
+        table->setRowCount(sample.sensors.size());
+        for (int row = 0; row < sample.sensors.size(); row++) {
+            const CMetrics::SensorSample &s = sample.sensors[row];
+            setCell(row, colSensor, s.name);
+            setCell(row, colKBytes, QString::number(s.bytesPerSec / 1024.0, 'f', 1));
+            setCell(row, colPackets, QString::number(s.packetsPerSec, 'f', 1));
+            setCell(row, colScans, QString::number(s.scansPerSec, 'f', 1));
+            setCell(row, colPoints, QString::number(qRound(s.pointsPerSec)));
+            setCell(row, colPartial, QString::number(s.partialReceives));
+            setCell(row, colDropped, QString::number(s.dropped));
+            setCell(row, colQueue, QString::number(s.depth));
+        }
+    }
+
+    void setCell(int row, int col, const QString &text) {
+        QTableWidgetItem *item = table->item(row, col);
+        if (!item) {
+            item = new QTableWidgetItem();
+            table->setItem(row, col, item);
+        }
+        item->setText(text);
+    }
+};
+
+#endif // CMETRICSPANEL_H
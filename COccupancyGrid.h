@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COCCUPANCYGRID_H
+#define COCCUPANCYGRID_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QVector>
+#include <QtCore/QHash>
+#include <QtCore/QPointF>
+#include <QtCore/QMutex>
+#include "CMapStore.h"
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+// Occupancy grid accumulated from scans with log-odds updates.
+// Cells hold qint8 log-odds (0 = unknown) grouped into TileSize x TileSize
+// tiles that are taken from a block pool the first time a ray touches them,
+// so memory follows the explored area. Each tile records the grid version
+// (one per integrated scan) that last changed it, which lets the renderer
+// keep per-tile images and rebuild only the tiles that moved.
+//
+// Above the fine grid sits a pyramid of LevelCount - 1 coarser levels, each
+// halving the resolution. Only the quadrants under fine tiles changed by a
+// scan are re-reduced, so keeping the pyramid current costs a fraction of
+// the ray casting, and a zoomed-out view can draw a coarse level with about
+// as many tiles as a zoomed-in one.
+//
+// With a CMapStore attached the grid becomes a write-back cache over the
+// mapped file: tile() falls back to the stored copy, acquire() pages a
+// stored tile into the pool before modifying it, and flush() writes changed
+// tiles back and evicts those no scan has touched for a while. RAM then
+// holds only the recently scanned area; everything else is file pages the
+// OS maps in as the view reaches them.
+class COccupancyGrid {
+public:
+    static constexpr int TileShift = 6;
+    static constexpr int TileSize = 1 << TileShift;
+    static constexpr int TileMask = TileSize - 1;
+    static constexpr int TileCells = TileSize * TileSize;
+    static constexpr int BlockTiles = 64;
+    static constexpr int LevelCount = 8;
+
+    static constexpr int HitDelta = 9;          // ~10 * log(0.7 / 0.3)
+    static constexpr int MissDelta = -4;        // ~10 * log(0.4 / 0.6)
+    static constexpr int MinLogOdds = -100;
+    static constexpr int MaxLogOdds = 100;
+
+    struct Tile {
+        qint8 cells[TileCells];
+        qint32 tx;
+        qint32 ty;
+        qint32 level;
+        quint32 version;
+        quint32 stored;     // version last written to the store
+    };
+
+    COccupancyGrid(float cellSize = 0.05f, float maxRange = 30.0f)
+        : m_cellSize(cellSize), m_invCellSize(1.0f / cellSize), m_maxRange(maxRange)
+    {
+    }
+    ~COccupancyGrid() {
+        for (Tile *block : m_blocks)
+            delete[] block;
+    }
+    Q_DISABLE_COPY(COccupancyGrid)
+
+    // origin and hits in meters, map frame. Every hit marks the cells along
+    // the ray from origin as free and its end cell as occupied.
+    void integrate(const QPointF &origin, const QPointF *hits, int count) {
+        m_version++;
+        const int ox = toCell(origin.x());
+        const int oy = toCell(origin.y());
+        const double maxRange2 = double(m_maxRange) * m_maxRange;
+
+        Tile *tile = nullptr;
+        for (int i = 0; i < count; i++) {
+            const double dx = hits[i].x() - origin.x();
+            const double dy = hits[i].y() - origin.y();
+            const double range2 = dx * dx + dy * dy;
+            if (range2 <= 0.0 || range2 > maxRange2)
+                continue;
+            castRay(ox, oy, toCell(hits[i].x()), toCell(hits[i].y()), tile);
+        }
+        updatePyramid();
+    }
+
+    const Tile *tile(int tx, int ty, int level = 0) const {
+        const Tile *tile = m_levels[level].tiles.value(tileKey(tx, ty), nullptr);
+        if (!tile && m_store)
+            tile = static_cast<const Tile *>(m_store->find(level, tx, ty));
+        return tile;
+    }
+
+    // Attaches an open store; versions continue from the stored map so cached
+    // tile images are never mistaken for current ones.
+    void setStore(CMapStore *store) {
+        m_store = (store && store->isOpen()) ? store : nullptr;
+        if (m_store)
+            m_version = qMax(m_version, m_store->mapVersion()) + 1;
+    }
+
+    // Writes tiles changed since the last flush to the store and evicts tiles
+    // unchanged for evictAge scans. Without a store nothing is evicted.
+    void flush(quint32 evictAge = 200) {
+        if (!m_store)
+            return;
+        for (Level &level : m_levels) {
+            for (auto it = level.tiles.begin(); it != level.tiles.end();) {
+                Tile *tile = it.value();
+                if (tile->version != tile->stored) {
+                    void *slot = m_store->insert(tile->level, tile->tx, tile->ty);
+                    if (!slot) {
+                        ++it;
+                        continue;
+                    }
+                    tile->stored = tile->version;
+                    memcpy(slot, tile, sizeof(Tile));
+                }
+                if (m_version - tile->version > evictAge) {
+                    m_free.append(tile);
+                    it = level.tiles.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+        m_store->setMapVersion(m_version);
+        m_store->sync();
+    }
+
+    void clear() {
+        for (Level &level : m_levels) {
+            for (Tile *tile : qAsConst(level.tiles))
+                m_free.append(tile);
+            level.tiles.clear();
+            level.hasBounds = false;
+        }
+        m_dirty.clear();
+        m_version++;
+    }
+
+    // Tile index range touched so far (inclusive); false while empty.
+    bool tileBounds(int &tx0, int &ty0, int &tx1, int &ty1, int level = 0) const {
+        const Level &lv = m_levels[level];
+        tx0 = lv.minTx; ty0 = lv.minTy;
+        tx1 = lv.maxTx; ty1 = lv.maxTy;
+
+        int sx0, sy0, sx1, sy1;
+        if (!m_store || !m_store->bounds(level, sx0, sy0, sx1, sy1))
+            return lv.hasBounds;
+        if (!lv.hasBounds) {
+            tx0 = sx0; ty0 = sy0;
+            tx1 = sx1; ty1 = sy1;
+            return true;
+        }
+        tx0 = qMin(tx0, sx0); ty0 = qMin(ty0, sy0);
+        tx1 = qMax(tx1, sx1); ty1 = qMax(ty1, sy1);
+        return true;
+    }
+
+    // Coarsest level whose cells still cover at most one screen pixel, given
+    // the on-screen size of a fine cell.
+    static int levelFor(double cellPixels) {
+        int level = 0;
+        while (level < LevelCount - 1 && cellPixels * (2 << level) <= 1.0)
+            level++;
+        return level;
+    }
+
+    int toCell(double meters) const {
+        return int(std::floor(meters * m_invCellSize));
+    }
+
+    static quint64 tileKey(int tx, int ty) {
+        return (quint64(quint32(tx)) << 32) | quint32(ty);
+    }
+
+    float cellSize() const { return m_cellSize; }
+    float tileSpan(int level = 0) const { return m_cellSize * TileSize * (1 << level); }
+    float maxRange() const { return m_maxRange; }
+    quint32 version() const { return m_version; }
+    int tileCount(int level = 0) const { return m_levels[level].tiles.size(); }
+
+    // The grid itself is not thread-safe; writers (integrate, flush) and
+    // readers on other threads hold this.
+    QMutex *mutex() const { return &m_mutex; }
+    qint64 memoryBytes() const { return qint64(m_blocks.size()) * BlockTiles * sizeof(Tile); }
+
+private:
+    mutable QMutex m_mutex;
+    float m_cellSize;
+    float m_invCellSize;
+    float m_maxRange;
+    quint32 m_version = 0;
+
+    struct Level {
+        QHash<quint64, Tile *> tiles;
+        bool hasBounds = false;
+        int minTx = 0, minTy = 0, maxTx = 0, maxTy = 0;
+    };
+    Level m_levels[LevelCount];
+    CMapStore *m_store = nullptr;
+    QVector<Tile *> m_blocks;
+    QVector<Tile *> m_free;
+    QVector<Tile *> m_dirty;        // tiles changed by the current scan
+    QVector<Tile *> m_dirtyNext;
+
+    // Integer Bresenham walk; the tile pointer is carried across cells and
+    // rays so the hash is only consulted when a tile border is crossed.
+    void castRay(int x0, int y0, int x1, int y1, Tile *&tile) {
+        const int dx = std::abs(x1 - x0);
+        const int dy = -std::abs(y1 - y0);
+        const int sx = x0 < x1 ? 1 : -1;
+        const int sy = y0 < y1 ? 1 : -1;
+        int err = dx + dy;
+        int x = x0, y = y0;
+
+        while (x != x1 || y != y1) {
+            update(x, y, MissDelta, tile);
+            const int e2 = 2 * err;
+            if (e2 >= dy) {
+                err += dy;
+                x += sx;
+            }
+            if (e2 <= dx) {
+                err += dx;
+                y += sy;
+            }
+        }
+        update(x1, y1, HitDelta, tile);
+    }
+
+    inline void update(int x, int y, int delta, Tile *&tile) {
+        const int tx = x >> TileShift;
+        const int ty = y >> TileShift;
+        if (!tile || tile->tx != tx || tile->ty != ty)
+            tile = acquire(0, tx, ty);
+
+        qint8 &cell = tile->cells[((y & TileMask) << TileShift) | (x & TileMask)];
+        const int value = qBound(MinLogOdds, cell + delta, MaxLogOdds);
+        if (value != cell) {
+            cell = qint8(value);
+            markDirty(tile, m_dirty);
+        }
+    }
+
+    inline void markDirty(Tile *tile, QVector<Tile *> &dirty) {
+        if (tile->version != m_version) {
+            tile->version = m_version;
+            dirty.append(tile);
+        }
+    }
+
+    // A parent cell takes its most occupied child if any child is occupied,
+    // otherwise its most confidently free child, so thin walls survive.
+    void updatePyramid() {
+        for (int level = 1; level < LevelCount && !m_dirty.isEmpty(); level++) {
+            m_dirtyNext.resize(0);
+            for (Tile *child : qAsConst(m_dirty)) {
+                Tile *parent = acquire(level, child->tx >> 1, child->ty >> 1);
+                const int ox = (child->tx & 1) * (TileSize / 2);
+                const int oy = (child->ty & 1) * (TileSize / 2);
+                bool changed = false;
+                for (int py = 0; py < TileSize / 2; py++) {
+                    const qint8 *row0 = child->cells + (py * 2) * TileSize;
+                    const qint8 *row1 = row0 + TileSize;
+                    qint8 *dst = parent->cells + (oy + py) * TileSize + ox;
+                    for (int px = 0; px < TileSize / 2; px++) {
+                        const int a = row0[px * 2], b = row0[px * 2 + 1];
+                        const int c = row1[px * 2], d = row1[px * 2 + 1];
+                        const int hi = qMax(qMax(a, b), qMax(c, d));
+                        const int lo = qMin(qMin(a, b), qMin(c, d));
+                        const qint8 value = qint8(hi > 0 ? hi : lo);
+                        if (dst[px] != value) {
+                            dst[px] = value;
+                            changed = true;
+                        }
+                    }
+                }
+                if (changed)
+                    markDirty(parent, m_dirtyNext);
+            }
+            m_dirty.swap(m_dirtyNext);
+        }
+        m_dirty.resize(0);
+    }
+
+    Tile *acquire(int level, int tx, int ty) {
+        Level &lv = m_levels[level];
+        const quint64 key = tileKey(tx, ty);
+        Tile *tile = lv.tiles.value(key, nullptr);
+        if (tile)
+            return tile;
+
+        if (m_free.isEmpty()) {
+            Tile *block = new Tile[BlockTiles];
+            m_blocks.append(block);
+            for (int i = BlockTiles - 1; i >= 0; i--)
+                m_free.append(block + i);
+        }
+        tile = m_free.last();
+        m_free.removeLast();
+
+        const void *stored = m_store ? m_store->find(level, tx, ty) : nullptr;
+        if (stored) {
+            memcpy(tile, stored, sizeof(Tile));
+        }
+        else {
+            memset(tile->cells, 0, sizeof(tile->cells));
+            tile->tx = tx;
+            tile->ty = ty;
+            tile->level = level;
+            tile->version = m_version - 1;      // not dirty yet
+            tile->stored = tile->version;
+        }
+        lv.tiles.insert(key, tile);
+
+        if (!lv.hasBounds) {
+            lv.minTx = lv.maxTx = tx;
+            lv.minTy = lv.maxTy = ty;
+            lv.hasBounds = true;
+        }
+        else {
+            lv.minTx = qMin(lv.minTx, tx);
+            lv.maxTx = qMax(lv.maxTx, tx);
+            lv.minTy = qMin(lv.minTy, ty);
+            lv.maxTy = qMax(lv.maxTy, ty);
+        }
+        return tile;
+    }
+};
+
+#endif // COCCUPANCYGRID_H
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPIPELINE_H
+#define CPIPELINE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QMetaObject>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "CClock.h"
+#include "CWorkPool.h"
+
+// Chain of stages a job passes through in order. Each stage has a bounded
+// queue and runs at most one drain task at a time, so a stage sees its jobs
+// in order and may keep state between them, while different stages (and
+// different pipelines) run in parallel on the work pool. Stages flagged
+// main run on the thread of the context object instead, for widgets and
+// sockets.
+//
+// Stale work policy: a full queue drops its oldest job; scans are only worth
+// processing while they are fresh. A stage added with eFull::grow never
+// drops and grows its queue instead, for work that has to see every job,
+// such as decoding a byte stream whose records span receives. A stage
+// returning false ends the job.
+// Queues are rings that only grow, and pool tasks fit std::function's inline
+// storage, so passing a job along does not allocate (posting to the main
+// thread does, through Qt's event queue).
+template <class Job>
+class CPipeline {
+public:
+    using JobPtr = std::shared_ptr<Job>;
+    using Work = std::function<bool(Job &)>;
+
+    enum class eThread { pool, main };
+    enum class eFull { dropOldest, grow };
+
+    struct StageStats {
+        QString name;
+        int depth = 0;
+        int capacity = 0;
+        quint64 done = 0;
+        quint64 dropped = 0;
+        double meanMs = 0.0;    // queued + processing, since the last stats(true)
+        double maxMs = 0.0;
+    };
+
+    CPipeline(QObject *context, CWorkPool &pool = CWorkPool::global())
+        : m_inner(new Inner(context, pool))
+    {
+    }
+    ~CPipeline()
+    {
+        close();
+    }
+
+    // Stops accepting jobs and waits for pool stages to finish the job in
+    // hand. Call before tearing down what the stages use.
+    void close()
+    {
+        Inner *inner = m_inner.get();
+        inner->closed = true;
+        QMutexLocker locker(&inner->idleMutex);
+        while (inner->active > 0)
+            inner->idle.wait(&inner->idleMutex);
+    }
+
+    // capacity: queued jobs before the oldest is dropped or, with
+    // eFull::grow, the initial queue size.
+    void addStage(const QString &name, Work work, int capacity = 2, eThread thread = eThread::pool,
+                  eFull full = eFull::dropOldest)
+    {
+        Stage *stage = new Stage;
+        stage->name = name;
+        stage->work = work;
+        stage->capacity = qMax(1, capacity);
+        stage->ring.resize(stage->capacity);
+        stage->thread = thread;
+        stage->full = full;
+        m_inner->stages.emplace_back(stage);
+    }
+
+    void push(const JobPtr &job)
+    {
+        Inner::enqueue(m_inner.get(), 0, job);
+    }
+
+    quint64 dropped() const
+    {
+        quint64 total = 0;
+        for (auto &stage : m_inner->stages) {
+            QMutexLocker locker(&stage->mutex);
+            total += stage->dropped;
+        }
+        return total;
+    }
+
+    // Jobs queued across all stages.
+    int depth() const
+    {
+        int total = 0;
+        for (auto &stage : m_inner->stages) {
+            QMutexLocker locker(&stage->mutex);
+            total += stage->size;
+        }
+        return total;
+    }
+
+    // reset: restart the latency window after reading.
+    QVector<StageStats> stats(bool reset = false)
+    {
+        QVector<StageStats> list;
+        for (auto &stage : m_inner->stages) {
+            QMutexLocker locker(&stage->mutex);
+            StageStats s;
+            s.name = stage->name;
+            s.depth = stage->size;
+            s.capacity = stage->capacity;
+            s.done = stage->done;
+            s.dropped = stage->dropped;
+            const quint64 window = stage->done - stage->windowStart;
+            s.meanMs = window ? stage->latencySum / 1e6 / window : 0.0;
+            s.maxMs = stage->latencyMax / 1e6;
+            if (reset) {
+                stage->windowStart = stage->done;
+                stage->latencySum = 0;
+                stage->latencyMax = 0;
+            }
+            list.append(s);
+        }
+        return list;
+    }
+
+private:
+    struct Entry {
+        JobPtr job;
+        qint64 queued;
+    };
+    struct Stage {
+        QString name;
+        Work work;
+        int capacity;
+        eThread thread;
+        eFull full;
+        QMutex mutex;
+        QVector<Entry> ring;        // capacity slots, oldest at head
+        int head = 0, size = 0;
+        bool running = false;
+        quint64 done = 0, dropped = 0, windowStart = 0;
+        qint64 latencySum = 0, latencyMax = 0;
+    };
+    // Pool tasks hold a plain pointer; close() waits for them. Main-thread
+    // tasks may outlive the pipeline and hold a reference, finding it closed
+    // instead of freed.
+    struct Inner : std::enable_shared_from_this<Inner> {
+        Inner(QObject *context, CWorkPool &pool) : context(context), pool(pool) {}
+
+        QObject *context;
+        CWorkPool &pool;
+        std::vector<std::unique_ptr<Stage>> stages;
+        std::atomic<bool> closed{false};
+        std::atomic<int> active{0};     // pool tasks posted and not finished
+        QMutex idleMutex;
+        QWaitCondition idle;            // active dropped to 0
+
+        static void enqueue(Inner *inner, int index, const JobPtr &job)
+        {
+            if (inner->closed)
+                return;
+            Stage &stage = *inner->stages[index];
+            QMutexLocker locker(&stage.mutex);
+            if (stage.size == stage.capacity && stage.full == eFull::grow) {
+                grow(stage);
+            }
+            else if (stage.size == stage.capacity) {
+                stage.ring[stage.head] = Entry();
+                stage.head = (stage.head + 1) % stage.capacity;
+                stage.size--;
+                stage.dropped++;
+            }
+            stage.ring[(stage.head + stage.size) % stage.capacity] = Entry{job, CClock::nsecs()};
+            stage.size++;
+            if (stage.running)
+                return;
+            stage.running = true;
+            locker.unlock();
+
+            if (stage.thread == eThread::pool) {
+                inner->active++;
+                inner->pool.post([inner, index]() {
+                    drain(inner, index);
+                    if (--inner->active == 0) {
+                        QMutexLocker locker(&inner->idleMutex);
+                        inner->idle.wakeAll();
+                    }
+                });
+            }
+            else {
+                std::shared_ptr<Inner> keep = inner->shared_from_this();
+                QMetaObject::invokeMethod(inner->context, [keep, index]() {
+                    drain(keep.get(), index);
+                }, Qt::QueuedConnection);
+            }
+        }
+
+        static void grow(Stage &stage)
+        {
+            QVector<Entry> bigger(stage.capacity * 2);
+            for (int i = 0; i < stage.size; i++)
+                bigger[i] = std::move(stage.ring[(stage.head + i) % stage.capacity]);
+            stage.ring.swap(bigger);
+            stage.capacity *= 2;
+            stage.head = 0;
+        }
+
+        static void drain(Inner *inner, int index)
+        {
+            Stage &stage = *inner->stages[index];
+            for (;;) {
+                Entry entry;
+                {
+                    QMutexLocker locker(&stage.mutex);
+                    if (stage.size == 0 || inner->closed) {
+                        for (Entry &slot : stage.ring)
+                            slot = Entry();
+                        stage.head = stage.size = 0;
+                        stage.running = false;
+                        return;
+                    }
+                    entry = std::move(stage.ring[stage.head]);
+                    stage.ring[stage.head] = Entry();
+                    stage.head = (stage.head + 1) % stage.capacity;
+                    stage.size--;
+                }
+                const bool next = stage.work(*entry.job);
+                const qint64 latency = CClock::nsecs() - entry.queued;
+                {
+                    QMutexLocker locker(&stage.mutex);
+                    stage.done++;
+                    stage.latencySum += latency;
+                    stage.latencyMax = qMax(stage.latencyMax, latency);
+                }
+                if (next && index + 1 < int(inner->stages.size()))
+                    enqueue(inner, index + 1, entry.job);
+            }
+        }
+    };
+
+    std::shared_ptr<Inner> m_inner;
+};
+
+#endif // CPIPELINE_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPOSE2D_H
+#define CPOSE2D_H
+
+#include <QtCore/QPointF>
+#include <cmath>
+
+// Planar rigid transform: x, y in meters, theta in radians.
+// map() takes a point from this pose's local frame to the parent frame.
+struct CPose2D {
+    double x = 0.0;
+    double y = 0.0;
+    double theta = 0.0;
+
+    CPose2D() {}
+    CPose2D(double x, double y, double theta) : x(x), y(y), theta(theta) {}
+
+    QPointF map(const QPointF &p) const {
+        const double c = std::cos(theta), s = std::sin(theta);
+        return QPointF(x + c * p.x() - s * p.y(), y + s * p.x() + c * p.y());
+    }
+
+    // this * other: apply other first, then this.
+    CPose2D operator*(const CPose2D &other) const {
+        const double c = std::cos(theta), s = std::sin(theta);
+        return CPose2D(x + c * other.x - s * other.y,
+                       y + s * other.x + c * other.y,
+                       normalizeAngle(theta + other.theta));
+    }
+
+    CPose2D inverse() const {
+        const double c = std::cos(theta), s = std::sin(theta);
+        return CPose2D(-c * x - s * y, s * x - c * y, normalizeAngle(-theta));
+    }
+
+    // Blend between a (t = 0) and b (t = 1).
+    static CPose2D interpolate(const CPose2D &a, const CPose2D &b, double t) {
+        return CPose2D(a.x + (b.x - a.x) * t,
+                       a.y + (b.y - a.y) * t,
+                       normalizeAngle(a.theta + normalizeAngle(b.theta - a.theta) * t));
+    }
+
+    static double normalizeAngle(double a) {
+        while (a > M_PI)
+            a -= 2.0 * M_PI;
+        while (a <= -M_PI)
+            a += 2.0 * M_PI;
+        return a;
+    }
+};
+
+#endif // CPOSE2D_H
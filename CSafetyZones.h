@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSAFETYZONES_H
+#define CSAFETYZONES_H
+
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QString>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+#include <QtCore/QtMath>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <atomic>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+
+#include "CClock.h"
+#include "CScan.h"
+#include "CSimd.h"
+
+// Warning/protective fields around the sensor. Each polygon is compiled into
+// a [near, far] range interval per beam (mm), so a scan is checked with two
+// compares per beam and zone. For a polygon the beam crosses more than once
+// the interval spans from the first entry to the last exit, which can only
+// over-report. Zones may be loaded and drawn on one thread while scans are
+// evaluated on another.
+//
+// Receives carry arbitrary slices of a revolution, so the latest range of
+// every beam is kept across them and each evaluation judges the whole
+// revolution. A beam without a return (range 0 or NaN) through a
+// protective zone counts as violating: no measurement is not a clear
+// field. Until a beam has been measured it is such a dropout.
+class CSafetyZones : public QObject {
+    Q_OBJECT
+
+public:
+    enum class eZoneType : int { warning = 0, protective };
+
+    struct Zone {
+        QString name;
+        eZoneType type = eZoneType::warning;
+        QVector<QPointF> polygon;   // meters, sensor frame
+        bool violated = false;
+        int beams = 0;              // violating beams at the last evaluation
+    };
+
+    static constexpr int maxZones = 8;  // one bit per zone in beamMask()
+
+    CSafetyZones(QObject *parent = nullptr, int beams = 1200)
+        : QObject(parent), m_beams(beams)
+    {
+        m_range.resize(m_beams);
+        m_mask.resize(m_beams);
+    }
+
+    // Zones file:
+    //   {"zones": [{"name": "Stop", "type": "protective", "points": [[x, y], ...]}, ...]}
+    bool load(const QString &path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+        if (!doc.isObject())
+            return false;
+        QVector<Zone> zones;
+        for (const QJsonValue &value : doc.object().value("zones").toArray()) {
+            const QJsonObject obj = value.toObject();
+            Zone zone;
+            zone.name = obj.value("name").toString();
+            zone.type = obj.value("type").toString() == "protective" ? eZoneType::protective : eZoneType::warning;
+            for (const QJsonValue &pt : obj.value("points").toArray()) {
+                const QJsonArray xy = pt.toArray();
+                zone.polygon.append(QPointF(xy.at(0).toDouble(), xy.at(1).toDouble()));
+            }
+            if (zone.polygon.size() >= 3)
+                zones.append(zone);
+        }
+        setZones(zones);
+        return true;
+    }
+
+    void setZones(const QVector<Zone> &zones)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_zones = zones.mid(0, maxZones);
+        compileZones();
+    }
+
+    // Tables to match the sensor's beams per revolution. On a change every
+    // beam counts as not yet measured until the new sensor's scans cover it.
+    void setBeams(int beams)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (beams == m_beams || beams <= 0)
+            return;
+        m_beams = beams;
+        m_range.fill(0.0f, m_beams);
+        compileZones();
+    }
+
+    QVector<Zone> zones() const {
+        QMutexLocker locker(&m_mutex);
+        return m_zones;
+    }
+    int beams() const {
+        QMutexLocker locker(&m_mutex);
+        return m_beams;
+    }
+    // Bit z set where zone z is violated, per beam at the last evaluation;
+    // only stable on the evaluating thread.
+    const quint8 *beamMask() const { return m_mask.constData(); }
+
+    void setMinBeams(int minBeams) { m_minBeams = qMax(1, minBeams); }
+
+    // Receive-to-decision latency, microseconds.
+    double lastLatency() const { return m_lastLatency / 1000.0; }
+    double maxLatency() const { return m_maxLatency / 1000.0; }
+    double meanLatency() const { return m_evaluations ? m_sumLatency / 1000.0 / m_evaluations : 0.0; }
+    void resetLatency() {
+        m_maxLatency = 0;
+        m_sumLatency = 0;
+        m_evaluations = 0;
+    }
+
+    // arrivalStamp: CClock time the scan's data arrived at the socket.
+    // Raises onAlert when a zone becomes violated or clear. Returns the
+    // number of violated zones.
+    int evaluate(const CScan &scan, qint64 arrivalStamp)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_zones.isEmpty())
+            return 0;
+
+        float *range = m_range.data();
+        const float perDegree = m_beams / 360.0f;
+        const float *scanAngle = scan.angle();
+        const float *scanRange = scan.range();
+        for (int i = 0; i < scan.size(); i++) {
+            int b = int(scanAngle[i] * perDegree + 0.5f) % m_beams;
+            if (b < 0)
+                b += m_beams;
+            range[b] = scanRange[i];
+        }
+
+        memset(m_mask.data(), 0, m_beams);
+        int violated = 0;
+        for (int z = 0; z < m_zones.size(); z++) {
+            const int beams = check(range, m_near.constData() + z * m_beams,
+                                    m_far.constData() + z * m_beams, quint8(1 << z),
+                                    m_zones[z].type == eZoneType::protective);
+            m_zones[z].beams = beams;
+            if (beams >= m_minBeams)
+                violated++;
+        }
+
+        const qint64 latency = CClock::nsecs() - arrivalStamp;
+        m_lastLatency = latency;
+        if (latency > m_maxLatency)
+            m_maxLatency = latency;
+        m_sumLatency += latency;
+        m_evaluations++;
+
+        QVector<int> codes;
+        QStringList msgs;
+        for (int z = 0; z < m_zones.size(); z++) {
+            Zone &zone = m_zones[z];
+            const bool now = zone.beams >= m_minBeams;
+            if (now == zone.violated)
+                continue;
+            zone.violated = now;
+            const QString type = zone.type == eZoneType::protective ? "Protective" : "Warning";
+            codes.append(z);
+            msgs.append(QString("%1 zone %2 %3 (%4 ms)")
+                        .arg(type, zone.name, now ? "violated" : "clear")
+                        .arg(latency / 1e6, 0, 'f', 2));
+        }
+        locker.unlock();
+        for (int i = 0; i < codes.size(); i++)
+            emit onAlert(this, codes[i], msgs[i]);
+        return violated;
+    }
+
+signals:
+    void onAlert(CSafetyZones *sender, int alertCode, const QString msg);
+
+private:
+    mutable QMutex m_mutex;
+    int m_beams;
+    int m_minBeams = 2;
+    QVector<Zone> m_zones;
+    QVector<float> m_near, m_far;   // zone-major, m_beams per zone
+    QVector<float> m_range;         // latest range per beam, mm; 0 until measured
+    QVector<quint8> m_mask;
+    std::atomic<qint64> m_lastLatency{0}, m_maxLatency{0}, m_sumLatency{0};
+    std::atomic<qint64> m_evaluations{0};
+
+    void compileZones()
+    {
+        m_near.resize(m_zones.size() * m_beams);
+        m_far.resize(m_zones.size() * m_beams);
+        for (int z = 0; z < m_zones.size(); z++)
+            compile(m_zones[z].polygon, m_near.data() + z * m_beams, m_far.data() + z * m_beams);
+        m_mask.fill(0, m_beams);
+    }
+
+    void compile(const QVector<QPointF> &polygon, float *nearRange, float *farRange) const
+    {
+        const bool inside = contains(polygon, QPointF(0, 0));
+        const int n = polygon.size();
+        for (int b = 0; b < m_beams; b++) {
+            const double angle = qDegreesToRadians(b * 360.0 / m_beams);
+            const QPointF d(std::cos(angle), std::sin(angle));
+            double tMin = DBL_MAX, tMax = -1.0;
+            for (int i = 0; i < n; i++) {
+                const QPointF p = polygon[i];
+                const QPointF e = polygon[(i + 1) % n] - p;
+                const double denom = cross(d, e);
+                if (std::fabs(denom) < 1e-12)
+                    continue;
+                const double t = cross(p, e) / denom;
+                const double s = cross(p, d) / denom;
+                if (t < 0.0 || s < 0.0 || s > 1.0)
+                    continue;
+                tMin = qMin(tMin, t);
+                tMax = qMax(tMax, t);
+            }
+            if (tMax < 0.0) {
+                nearRange[b] = FLT_MAX;     // never
+                farRange[b] = -1.0f;
+            }
+            else {
+                nearRange[b] = inside ? 0.0f : float(tMin * 1000.0);
+                farRange[b] = float(tMax * 1000.0);
+            }
+        }
+    }
+
+    // Counts beams with a return inside [near, far], or with failSafe a
+    // dropout on a beam that crosses the zone, and marks them in m_mask.
+    int check(const float *range, const float *nearRange, const float *farRange, quint8 bit, bool failSafe)
+    {
+        quint8 *mask = m_mask.data();
+        int hits = 0;
+        int b = 0;
+#ifdef LUMO_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 dropoutHits = failSafe ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+        for (; b <= m_beams - 4; b += 4) {
+            const __m128 r = _mm_loadu_ps(range + b);
+            const __m128 farR = _mm_loadu_ps(farRange + b);
+            const __m128 valid = _mm_cmpgt_ps(r, zero);
+            const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(r, _mm_loadu_ps(nearRange + b)),
+                                                        _mm_cmple_ps(r, farR)), valid);
+            const __m128 dropout = _mm_and_ps(_mm_andnot_ps(valid, _mm_cmpge_ps(farR, zero)), dropoutHits);
+            const int bits = _mm_movemask_ps(_mm_or_ps(inside, dropout));
+            if (!bits)
+                continue;
+            for (int k = 0; k < 4; k++) {
+                if (bits & (1 << k)) {
+                    mask[b + k] |= bit;
+                    hits++;
+                }
+            }
+        }
+#endif
+        for (; b < m_beams; b++) {
+            const float r = range[b];
+            const bool valid = r > 0.0f;
+            if ((valid && r >= nearRange[b] && r <= farRange[b]) ||
+                    (failSafe && !valid && farRange[b] >= 0.0f)) {
+                mask[b] |= bit;
+                hits++;
+            }
+        }
+        return hits;
+    }
+
+    static double cross(const QPointF &a, const QPointF &b)
+    {
+        return a.x() * b.y() - a.y() * b.x();
+    }
+
+    static bool contains(const QVector<QPointF> &polygon, const QPointF &p)
+    {
+        bool in = false;
+        for (int i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            const QPointF &a = polygon[i], &b = polygon[j];
+            if ((a.y() > p.y()) != (b.y() > p.y())
+                    && p.x() < (b.x() - a.x()) * (p.y() - a.y()) / (b.y() - a.y()) + a.x())
+                in = !in;
+        }
+        return in;
+    }
+};
+
+#endif // CSAFETYZONES_H
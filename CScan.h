@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCAN_H
+#define CSCAN_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QtMath>
+#include <QtCore/QtNumeric>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "CSimd.h"
+
+// One scan as separate float channels (structure of arrays), so a kernel
+// streams only what it uses: the filter touches range alone, the background
+// model angle and range. Channels are 16-byte aligned and padded to whole
+// SSE2 vectors. Angle (deg) and range (mm) always exist; intensity and time
+// are allocated once a source writes them; x/y (m, NaN for dropouts) are
+// computed from angle and range on first use after either was handed out
+// for writing. Storage is kept across resize(), so a reused scan does not
+// allocate.
+class CScan {
+public:
+    enum eChannel { Angle, Range, Intensity, Time, X, Y, ChannelCount };
+
+    CScan() = default;
+    CScan(const CScan &other) { *this = other; }
+    CScan &operator=(const CScan &other)
+    {
+        if (this == &other)
+            return *this;
+        resize(other.m_size);
+        for (int ch = 0; ch < ChannelCount; ch++) {
+            if (other.m_channel[ch])
+                memcpy(channel(ch), other.m_channel[ch], m_size * sizeof(float));
+        }
+        m_xyValid = other.m_xyValid && other.m_channel[X];
+        return *this;
+    }
+    ~CScan()
+    {
+        for (float *data : m_channel)
+            qFreeAligned(data);
+    }
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    // Keeps the contents up to the smaller size.
+    void resize(int size)
+    {
+        size = qMax(0, size);
+        if (size > m_capacity) {
+            const int capacity = (qMax(size, m_capacity + m_capacity / 2) + 3) & ~3;
+            for (float *&data : m_channel) {
+                if (!data)
+                    continue;
+                float *grown = allocChannel(capacity);
+                memcpy(grown, data, m_size * sizeof(float));
+                qFreeAligned(data);
+                data = grown;
+            }
+            m_capacity = capacity;
+        }
+        m_size = size;
+        m_xyValid = false;
+    }
+
+    float *angle() { m_xyValid = false; return channel(Angle); }
+    float *range() { m_xyValid = false; return channel(Range); }
+    float *intensity() { return channel(Intensity); }
+    float *time() { return channel(Time); }     // s after the first beam
+    const float *angle() const { return channel(Angle); }
+    const float *range() const { return channel(Range); }
+    const float *intensity() const { return m_channel[Intensity]; }    // null if never written
+    const float *time() const { return m_channel[Time]; }
+    const float *x() const { updateXY(); return m_channel[X]; }
+    const float *y() const { updateXY(); return m_channel[Y]; }
+
+    // count (angle deg, range mm) pairs, the layout on the wire.
+    void fromRecords(const float *records, int count)
+    {
+        resize(count);
+        float *a = angle();
+        float *r = range();
+        int i = 0;
+#ifdef LUMO_SSE2
+        for (; i + 4 <= count; i += 4) {
+            const __m128 lo = _mm_loadu_ps(records + i * 2);
+            const __m128 hi = _mm_loadu_ps(records + i * 2 + 4);
+            _mm_store_ps(a + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_store_ps(r + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#endif
+        for (; i < count; i++) {
+            a[i] = records[i * 2];
+            r[i] = records[i * 2 + 1];
+        }
+    }
+
+    void toRecords(float *records) const
+    {
+        const float *a = angle();
+        const float *r = range();
+        int i = 0;
+#ifdef LUMO_SSE2
+        for (; i + 4 <= m_size; i += 4) {
+            const __m128 va = _mm_load_ps(a + i);
+            const __m128 vr = _mm_load_ps(r + i);
+            _mm_storeu_ps(records + i * 2, _mm_unpacklo_ps(va, vr));
+            _mm_storeu_ps(records + i * 2 + 4, _mm_unpackhi_ps(va, vr));
+        }
+#endif
+        for (; i < m_size; i++) {
+            records[i * 2] = a[i];
+            records[i * 2 + 1] = r[i];
+        }
+    }
+
+    // Channel memory held, for comparing layouts.
+    size_t bytes() const
+    {
+        size_t channels = 0;
+        for (const float *data : m_channel)
+            channels += data != nullptr;
+        return channels * m_capacity * sizeof(float);
+    }
+
+private:
+    int m_size = 0;
+    int m_capacity = 0;                     // floats per channel, multiple of 4
+    mutable float *m_channel[ChannelCount] = {};
+    mutable bool m_xyValid = false;
+
+    static float *allocChannel(int capacity)
+    {
+        return static_cast<float *>(qMallocAligned(qMax(4, capacity) * sizeof(float), 16));
+    }
+
+    // Allocated on first use.
+    float *channel(int ch) const
+    {
+        if (!m_channel[ch])
+            m_channel[ch] = allocChannel(m_capacity);
+        return m_channel[ch];
+    }
+
+    void updateXY() const
+    {
+        if (m_xyValid)
+            return;
+        const float *a = channel(Angle);
+        const float *r = channel(Range);
+        float *x = channel(X);
+        float *y = channel(Y);
+        for (int i = 0; i < m_size; i++) {
+            if (r[i] > 0.0f) {
+                const float radian = qDegreesToRadians(a[i]);
+                const float meters = r[i] * 0.001f;
+                x[i] = meters * std::cos(radian);
+                y[i] = meters * std::sin(radian);
+            }
+            else {
+                x[i] = y[i] = qQNaN();
+            }
+        }
+        m_xyValid = true;
+    }
+};
+
+#endif // CSCAN_H
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANARENA_H
+#define CSCANARENA_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QVector>
+#include <algorithm>
+#include <type_traits>
+
+// Bump allocator for the data of one scan; reset() releases everything
+// carved from it at once. A scan that does not fit spills into extra chunks,
+// and the next reset() replaces block and chunks with one block large enough
+// for that scan, so an arena that has seen the largest scan stops allocating.
+class CScanArena {
+public:
+    static const size_t Alignment = 16;    // SSE loads
+
+    CScanArena() = default;
+    CScanArena(const CScanArena &) = delete;
+    CScanArena &operator=(const CScanArena &) = delete;
+    ~CScanArena()
+    {
+        freeSpill();
+        qFreeAligned(m_block);
+    }
+
+    // Uninitialized room for count objects, valid until reset().
+    template <class T>
+    T *alloc(int count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+        const size_t size = (sizeof(T) * size_t(qMax(0, count)) + Alignment - 1) & ~(Alignment - 1);
+        m_used += size;
+        if (m_offset + size <= m_capacity) {
+            T *p = reinterpret_cast<T *>(m_block + m_offset);
+            m_offset += size;
+            return p;
+        }
+        void *chunk = qMallocAligned(size, Alignment);
+        m_spill.append(chunk);
+        m_grown++;
+        return static_cast<T *>(chunk);
+    }
+
+    template <class T>
+    T *copy(const T *src, int count)
+    {
+        T *dst = alloc<T>(count);
+        std::copy(src, src + count, dst);
+        return dst;
+    }
+
+    void reset()
+    {
+        if (!m_spill.isEmpty()) {
+            freeSpill();
+            qFreeAligned(m_block);
+            m_capacity = m_used + m_used / 4;   // room for a slightly larger scan
+            m_block = static_cast<char *>(qMallocAligned(m_capacity, Alignment));
+        }
+        m_offset = 0;
+        m_used = 0;
+    }
+
+    size_t capacity() const { return m_capacity; }
+    size_t used() const { return m_used; }
+    quint64 grown() const { return m_grown; }  // chunks allocated past the block
+
+private:
+    char *m_block = nullptr;
+    size_t m_capacity = 0;
+    size_t m_offset = 0;
+    size_t m_used = 0;          // this scan, block and chunks
+    QVector<void *> m_spill;
+    quint64 m_grown = 0;
+
+    void freeSpill()
+    {
+        for (void *chunk : qAsConst(m_spill))
+            qFreeAligned(chunk);
+        m_spill.resize(0);
+    }
+};
+
+#endif // CSCANARENA_H
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANFILTER_H
+#define CSCANFILTER_H
+
+#include <QtCore/QVector>
+#include <QtCore/QtMath>
+#include <cmath>
+#include <cstring>
+
+#include "CScan.h"
+#include "CSimd.h"
+
+// Removes noise from a scan before it is drawn, mapped or re-broadcast.
+// Works on the range channel of the scan only, in passes:
+//   gate    out-of-range returns become dropouts (0)
+//   shadow  returns behind a neighbour and seen at a grazing angle from it
+//           (mixed pixels and veiling at depth edges) become dropouts
+//   median  3 or 5 beam median, dropouts stay dropouts
+// Each pass is four beams wide with SSE2 and scalar for the tail.
+class CScanFilter {
+public:
+    struct Options {
+        bool  enabled = true;
+        float minRange = 50.0f;         // mm
+        float maxRange = 40000.0f;      // mm
+        int   medianWindow = 3;         // 0 (off), 3 or 5
+        float shadowAngle = qDegreesToRadians(8.0f);  // 0 disables
+    };
+
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+
+    // Filters the range channel in place. Returns the number of returns removed.
+    int apply(CScan &scan)
+    {
+        const int count = scan.size();
+        if (!m_options.enabled || count <= 0)
+            return 0;
+        m_work.resize(count);
+        float *const out = scan.range();
+        float *range = out;
+        float *work = m_work.data();
+
+        const int before = valid(range, count);
+        gate(range, count, m_options.minRange, m_options.maxRange);
+        if (m_options.shadowAngle > 0.0f && count >= 3) {
+            shadow(range, work, count, beamSpacing(scan.angle(), count), std::tan(m_options.shadowAngle));
+            qSwap(range, work);
+        }
+        if (m_options.medianWindow == 3 && count >= 3) {
+            median3(range, work, count);
+            qSwap(range, work);
+        }
+        else if (m_options.medianWindow == 5 && count >= 5) {
+            median5(range, work, count);
+            qSwap(range, work);
+        }
+        if (range != out)
+            memcpy(out, range, count * sizeof(float));
+        return before - valid(out, count);
+    }
+
+private:
+    Options m_options;
+    QVector<float> m_work;
+
+    static int valid(const float *r, int n)
+    {
+        int count = 0;
+        for (int i = 0; i < n; i++)
+            count += r[i] > 0.0f;
+        return count;
+    }
+
+    // Mean angular step, radians; the scan is assumed evenly spaced.
+    static float beamSpacing(const float *angle, int count)
+    {
+        if (count < 2)
+            return 0.0f;
+        float span = angle[count - 1] - angle[0];
+        if (span < 0.0f)
+            span += 360.0f;
+        return qDegreesToRadians(span / (count - 1));
+    }
+
+    static void gate(float *r, int n, float lo, float hi)
+    {
+        int i = 0;
+#ifdef LUMO_SSE2
+        const __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(r + i);
+            __m128 keep = _mm_and_ps(_mm_cmpge_ps(v, vlo), _mm_cmple_ps(v, vhi));
+            _mm_storeu_ps(r + i, _mm_and_ps(v, keep));
+        }
+#endif
+        for (; i < n; i++) {
+            if (!(r[i] >= lo && r[i] <= hi))
+                r[i] = 0.0f;
+        }
+    }
+
+    static float med3(float a, float b, float c)
+    {
+        return qMax(qMin(a, b), qMin(qMax(a, b), c));
+    }
+
+    static void median3(const float *r, float *out, int n)
+    {
+        out[0] = r[0];
+        out[n - 1] = r[n - 1];
+        int i = 1;
+#ifdef LUMO_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= n - 1; i += 4) {
+            __m128 a = _mm_loadu_ps(r + i - 1);
+            __m128 b = _mm_loadu_ps(r + i);
+            __m128 c = _mm_loadu_ps(r + i + 1);
+            __m128 m = _mm_max_ps(_mm_min_ps(a, b), _mm_min_ps(_mm_max_ps(a, b), c));
+            _mm_storeu_ps(out + i, _mm_andnot_ps(_mm_cmpeq_ps(b, zero), m));
+        }
+#endif
+        for (; i < n - 1; i++)
+            out[i] = r[i] > 0.0f ? med3(r[i - 1], r[i], r[i + 1]) : 0.0f;
+    }
+
+    // median(a..e) = median(e, max(min(a,b), min(c,d)), min(max(a,b), max(c,d)))
+    static void median5(const float *r, float *out, int n)
+    {
+        out[0] = r[0];
+        out[1] = r[1];
+        out[n - 2] = r[n - 2];
+        out[n - 1] = r[n - 1];
+        int i = 2;
+#ifdef LUMO_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= n - 2; i += 4) {
+            __m128 a = _mm_loadu_ps(r + i - 2);
+            __m128 b = _mm_loadu_ps(r + i - 1);
+            __m128 c = _mm_loadu_ps(r + i + 1);
+            __m128 d = _mm_loadu_ps(r + i + 2);
+            __m128 e = _mm_loadu_ps(r + i);
+            __m128 f = _mm_max_ps(_mm_min_ps(a, b), _mm_min_ps(c, d));
+            __m128 g = _mm_min_ps(_mm_max_ps(a, b), _mm_max_ps(c, d));
+            __m128 m = _mm_max_ps(_mm_min_ps(e, f), _mm_min_ps(_mm_max_ps(e, f), g));
+            _mm_storeu_ps(out + i, _mm_andnot_ps(_mm_cmpeq_ps(e, zero), m));
+        }
+#endif
+        for (; i < n - 2; i++) {
+            if (r[i] <= 0.0f) {
+                out[i] = 0.0f;
+                continue;
+            }
+            const float f = qMax(qMin(r[i - 2], r[i - 1]), qMin(r[i + 1], r[i + 2]));
+            const float g = qMin(qMax(r[i - 2], r[i - 1]), qMax(r[i + 1], r[i + 2]));
+            out[i] = med3(r[i], f, g);
+        }
+    }
+
+    // With neighbour range rn one beam away, the surface between the two
+    // returns makes an angle with the beam of atan(rn sin(d) / |r - rn cos(d)|).
+    // Only the farther return of a grazing pair is dropped.
+    static bool grazing(float r, float rn, float sinD, float cosD, float tanMin)
+    {
+        return rn > 0.0f && r > rn && rn * sinD < tanMin * std::fabs(r - rn * cosD);
+    }
+
+    static void shadow(const float *r, float *out, int n, float dphi, float tanMin)
+    {
+        const float sinD = std::sin(dphi), cosD = std::cos(dphi);
+        out[0] = r[0];
+        out[n - 1] = r[n - 1];
+        int i = 1;
+#ifdef LUMO_SSE2
+        const __m128 vsin = _mm_set1_ps(sinD), vcos = _mm_set1_ps(cosD), vtan = _mm_set1_ps(tanMin);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        for (; i + 4 <= n - 1; i += 4) {
+            __m128 v = _mm_loadu_ps(r + i);
+            __m128 drop = zero;
+            for (int side = -1; side <= 1; side += 2) {
+                __m128 rn = _mm_loadu_ps(r + i + side);
+                __m128 along = _mm_and_ps(_mm_sub_ps(v, _mm_mul_ps(rn, vcos)), absMask);
+                __m128 hit = _mm_cmplt_ps(_mm_mul_ps(rn, vsin), _mm_mul_ps(vtan, along));
+                hit = _mm_and_ps(hit, _mm_cmpgt_ps(v, rn));
+                drop = _mm_or_ps(drop, _mm_and_ps(hit, _mm_cmpgt_ps(rn, zero)));
+            }
+            _mm_storeu_ps(out + i, _mm_andnot_ps(drop, v));
+        }
+#endif
+        for (; i < n - 1; i++) {
+            const bool drop = grazing(r[i], r[i - 1], sinD, cosD, tanMin)
+                    || grazing(r[i], r[i + 1], sinD, cosD, tanMin);
+            out[i] = drop ? 0.0f : r[i];
+        }
+    }
+};
+
+#endif // CSCANFILTER_H
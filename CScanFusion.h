@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANFUSION_H
+#define CSCANFUSION_H
+
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QtGlobal>
+#include <algorithm>
+
+// Merges the latest scan of each sensor into one frame. Scans are already in
+// the vehicle frame; a scan takes part only if it is no older than window
+// relative to the newest one, so a stalled sensor drops out instead of
+// dragging stale points along.
+class CScanFusion {
+public:
+    struct Scan {
+        int sensor = 0;
+        qint64 stamp = 0;           // CClock nsecs at receive
+        QVector<QPointF> points;    // vehicle frame, meters
+    };
+    struct Frame {
+        qint64 stamp = 0;           // newest scan
+        qint64 skew = 0;            // newest - oldest scan in the frame
+        QVector<QPointF> points;
+        QVector<int> sensors;       // sensor of each part
+        QVector<int> offsets;       // first point of each part, plus points.size()
+    };
+
+    void setWindow(qint64 nsecs) { m_window = nsecs; }
+    qint64 window() const { return m_window; }
+
+    // Replaces the previous scan of the same sensor. Points are copied into
+    // storage kept per sensor rather than shared, so the caller may reuse its
+    // buffer and steady operation does not allocate.
+    void add(const Scan &scan)
+    {
+        add(scan.sensor, scan.stamp, scan.points.constData(), scan.points.size());
+    }
+    void add(int sensor, qint64 stamp, const QPointF *points, int count)
+    {
+        Scan *latest = nullptr;
+        for (Scan &scan : m_latest) {
+            if (scan.sensor == sensor)
+                latest = &scan;
+        }
+        if (!latest) {
+            m_latest.append(Scan());
+            latest = &m_latest.last();
+            latest->sensor = sensor;
+        }
+        latest->stamp = stamp;
+        latest->points.resize(count);
+        std::copy(points, points + count, latest->points.begin());
+    }
+
+    void remove(int sensor)
+    {
+        for (int i = 0; i < m_latest.size(); i++) {
+            if (m_latest[i].sensor == sensor) {
+                m_latest.remove(i);
+                return;
+            }
+        }
+    }
+
+    int sensorCount() const { return m_latest.size(); }
+
+    const Frame &fuse()
+    {
+        Frame &frame = m_frame;
+        frame.points.resize(0);
+        frame.sensors.resize(0);
+        frame.offsets.resize(0);
+        frame.stamp = 0;
+        for (const Scan &scan : m_latest)
+            frame.stamp = qMax(frame.stamp, scan.stamp);
+
+        qint64 oldest = frame.stamp;
+        for (const Scan &scan : m_latest) {
+            if (scan.stamp < frame.stamp - m_window)
+                continue;
+            oldest = qMin(oldest, scan.stamp);
+            frame.sensors.append(scan.sensor);
+            frame.offsets.append(frame.points.size());
+            frame.points += scan.points;
+        }
+        frame.offsets.append(frame.points.size());
+        frame.skew = frame.stamp - oldest;
+        return frame;
+    }
+
+    const Frame &frame() const { return m_frame; }
+
+private:
+    qint64 m_window = 150000000;    // 1.5 periods at 10 Hz
+    QVector<Scan> m_latest;
+    Frame m_frame;
+};
+
+#endif // CSCANFUSION_H
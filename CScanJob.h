@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANJOB_H
+#define CSCANJOB_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QPointF>
+
+#include <memory>
+
+#include "CDecoder.h"
+#include "CLatency.h"
+#include "CPose2D.h"
+#include "CScan.h"
+#include "CScanArena.h"
+#include "CScanSegmenter.h"
+#include "CLineExtractor.h"
+
+// One received scan on its way through the viewer pipeline. Each stage
+// fills in its part; later stages only read what earlier ones produced.
+// Jobs are recycled through a CJobPool: the receive buffer and the scan
+// channels keep their capacity and derived features are carved from the
+// job's arena, so a scan in steady state costs no heap allocation.
+struct CScanJob {
+    int sensor = 0;
+    qint64 stamp = 0;                       // CClock nsecs at receive
+    CLatency::Stamps times;
+    QByteArray raw;                         // as received
+    std::shared_ptr<CDecoder> decoder;      // of the connection it came on
+    bool reconnected = false;               // first receive of a new connection
+    CScanArena arena;
+
+    CScan scan;                             // decode
+    CScanSegmenter::Cluster *clusters = nullptr;    // transform
+    int clusterCount = 0;
+    CLineExtractor::Segment *segments = nullptr;
+    int segmentCount = 0;
+    QPointF *changes = nullptr;
+    int changeCount = 0;
+    int changed = 0;
+    QPointF *points = nullptr;              // valid returns, vehicle frame
+    int pointCount = 0;
+    CPose2D pose;                           // after matching
+
+    void reset()
+    {
+        arena.reset();
+        // raw is left alone: it is overwritten by the next receive, and
+        // resize(0) would free its buffer.
+        times = CLatency::Stamps();
+        decoder.reset();
+        reconnected = false;
+        scan.resize(0);
+        clusters = nullptr;
+        segments = nullptr;
+        changes = nullptr;
+        points = nullptr;
+        clusterCount = segmentCount = changeCount = changed = pointCount = 0;
+    }
+};
+
+#endif // CSCANJOB_H
@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANMATCHER_H
+#define CSCANMATCHER_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QMutex>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+
+#include "COccupancyGrid.h"
+#include "CPose2D.h"
+#include "CWorkPool.h"
+
+// Scan-to-map matcher.
+//
+// 1. A window of the map around the scan is turned into a likelihood grid
+//    and a stack of precomputed grids where level h holds, for each cell,
+//    the maximum of the 2^h x 2^h block starting there.
+// 2. For every rotation in the angular window the scan is discretized once
+//    and the translation window is searched branch-and-bound: a coarse
+//    candidate's score on level h bounds all of its children, so whole
+//    blocks are skipped once a better leaf is known. Rotations are searched
+//    in parallel and share the best score for pruning.
+// 3. The winner is refined with point-to-line ICP (Gauss-Newton) against
+//    occupied map cells, with line normals taken from their neighbourhood.
+class CScanMatcher {
+public:
+    static constexpr int MinPoints = 20;
+    static constexpr int MaxDepth = 7;
+
+    struct Options {
+        double linearWindow = 0.5;      // m, each side of the guess
+        double angularWindow = 0.35;    // rad, each side of the guess
+        double minScore = 0.35;         // mean likelihood needed to accept
+        int icpIterations = 8;
+        double icpMaxDist = 0.15;       // m, correspondence gate
+    };
+
+    struct Result {
+        CPose2D pose;
+        double score = 0.0;
+        bool matched = false;
+        int icpPairs = 0;
+    };
+
+    CScanMatcher() {
+        for (int i = 0; i < 256; i++) {
+            const int logOdds = qint8(quint8(i));
+            m_likelihood[i] = quint8(logOdds > 0 ? qMin(255, logOdds * 255 / COccupancyGrid::MaxLogOdds) : 0);
+        }
+    }
+
+    void setOptions(const Options &options) {
+        m_opt = options;
+    }
+
+    const Options &options() const {
+        return m_opt;
+    }
+
+    // points: scan in the sensor frame (m). guess: predicted sensor pose.
+    // The map is only read while the window around the scan is copied,
+    // under map.mutex(); the search runs on the copy, so call this without
+    // holding that lock and map painting is not blocked by the search.
+    Result match(const COccupancyGrid &map, const CPose2D &guess, const QPointF *points, int count) {
+        Result result;
+        result.pose = guess;
+        if (count < MinPoints)
+            return result;
+
+        m_cell = map.cellSize();
+        const int wc = qMax(1, int(std::ceil(m_opt.linearWindow / m_cell)));
+        int depth = 0;
+        while ((1 << depth) < wc && depth < MaxDepth)
+            depth++;
+
+        discretize(guess, points, count);
+        const int pad = wc + 2;
+        bool windowed;
+        {
+            QMutexLocker locker(map.mutex());
+            windowed = buildWindow(map, m_minX - pad, m_minY - pad, m_maxX + pad, m_maxY + pad);
+        }
+        if (!windowed)
+            return result;
+        buildPrecomputed(depth);
+
+        for (Job &job : m_jobs) {
+            job.index.resize(count);
+            for (int i = 0; i < count; i++)
+                job.index[i] = (job.cells[i * 2 + 1] - m_y0) * m_w + (job.cells[i * 2] - m_x0);
+        }
+
+        m_bestScore = int(m_opt.minScore * count * 255);
+        m_found = false;
+        CWorkPool::global().parallelFor(m_jobs.size(), [this, depth, wc](int i) {
+            searchAngle(m_jobs[i], depth, wc);
+        });
+        if (!m_found)
+            return result;
+
+        result.pose = CPose2D(guess.x + m_bestOx * m_cell, guess.y + m_bestOy * m_cell, m_bestTheta);
+        result.score = m_bestScore / (count * 255.0);
+        result.matched = true;
+        refine(result, points, count);
+        return result;
+    }
+
+private:
+    struct Candidate {
+        int ox;
+        int oy;
+        int score;
+    };
+
+    struct Job {
+        double theta = 0.0;
+        int k = 0;
+        QVector<int> cells;     // absolute map cells (x, y) per point
+        QVector<int> index;     // flat window index per point
+        QVector<Candidate> roots;
+    };
+
+    Options m_opt;
+    double m_cell = 0.05;
+    quint8 m_likelihood[256];
+
+    QVector<Job> m_jobs;
+    int m_minX = 0, m_minY = 0, m_maxX = 0, m_maxY = 0;
+
+    int m_x0 = 0, m_y0 = 0, m_w = 0, m_h = 0;
+    QVector<quint8> m_occ;                  // raw likelihood, for ICP
+    QVector<quint8> m_grids[MaxDepth + 1];  // precomputed max grids
+
+    std::atomic<int> m_bestScore{0};
+    QMutex m_bestMtx;
+    bool m_found = false;
+    double m_bestTheta = 0.0;
+    int m_bestOx = 0, m_bestOy = 0;
+
+    // Rotations spaced so the farthest point moves about one cell per step,
+    // searched nearest-to-guess first so good bounds are found early.
+    void discretize(const CPose2D &guess, const QPointF *points, int count) {
+        double maxRange2 = 0.0;
+        for (int i = 0; i < count; i++)
+            maxRange2 = qMax(maxRange2, points[i].x() * points[i].x() + points[i].y() * points[i].y());
+        const double maxRange = qMax(std::sqrt(maxRange2), 2.0 * m_cell);
+        const double step = std::acos(1.0 - (m_cell * m_cell) / (2.0 * maxRange * maxRange));
+        const int steps = qMin(1000, int(std::ceil(m_opt.angularWindow / step)));
+
+        m_jobs.resize(2 * steps + 1);
+        const double inv = 1.0 / m_cell;
+        m_minX = m_minY = INT_MAX;
+        m_maxX = m_maxY = INT_MIN;
+        for (int j = 0; j < m_jobs.size(); j++) {
+            Job &job = m_jobs[j];
+            job.k = (j & 1) ? (j + 1) / 2 : -(j / 2);
+            job.theta = CPose2D::normalizeAngle(guess.theta + job.k * step);
+            const double c = std::cos(job.theta), s = std::sin(job.theta);
+            job.cells.resize(count * 2);
+            for (int i = 0; i < count; i++) {
+                const int cx = int(std::floor((guess.x + c * points[i].x() - s * points[i].y()) * inv));
+                const int cy = int(std::floor((guess.y + s * points[i].x() + c * points[i].y()) * inv));
+                job.cells[i * 2] = cx;
+                job.cells[i * 2 + 1] = cy;
+                m_minX = qMin(m_minX, cx);
+                m_maxX = qMax(m_maxX, cx);
+                m_minY = qMin(m_minY, cy);
+                m_maxY = qMax(m_maxY, cy);
+            }
+        }
+    }
+
+    // Copies the map window into m_occ; false if it holds nothing occupied.
+    bool buildWindow(const COccupancyGrid &map, int x0, int y0, int x1, int y1) {
+        m_x0 = x0;
+        m_y0 = y0;
+        m_w = x1 - x0 + 1;
+        m_h = y1 - y0 + 1;
+        m_occ.resize(m_w * m_h);
+        m_occ.fill(0);
+
+        bool occupied = false;
+        const int shift = COccupancyGrid::TileShift;
+        const int size = COccupancyGrid::TileSize;
+        for (int ty = y0 >> shift; ty <= y1 >> shift; ty++) {
+            for (int tx = x0 >> shift; tx <= x1 >> shift; tx++) {
+                const COccupancyGrid::Tile *tile = map.tile(tx, ty);
+                if (!tile)
+                    continue;
+                const int cx0 = qMax(x0, tx * size), cx1 = qMin(x1, tx * size + size - 1);
+                const int cy0 = qMax(y0, ty * size), cy1 = qMin(y1, ty * size + size - 1);
+                for (int cy = cy0; cy <= cy1; cy++) {
+                    const qint8 *src = tile->cells + (cy - ty * size) * size;
+                    quint8 *dst = m_occ.data() + (cy - y0) * m_w;
+                    for (int cx = cx0; cx <= cx1; cx++) {
+                        const quint8 v = m_likelihood[quint8(src[cx - tx * size])];
+                        dst[cx - x0] = v;
+                        occupied |= (v != 0);
+                    }
+                }
+            }
+        }
+        return occupied;
+    }
+
+    void buildPrecomputed(int depth) {
+        // Level 0: likelihood spread by one cell at half weight, which makes
+        // the score tolerant to sub-cell misalignment.
+        // Copied into base's own buffer: assigning would share m_occ's, and
+        // writing to it would then detach, allocating on every match.
+        QVector<quint8> &base = m_grids[0];
+        base.resize(m_occ.size());
+        std::copy(m_occ.constBegin(), m_occ.constEnd(), base.begin());
+        for (int y = 1; y < m_h - 1; y++) {
+            const quint8 *row = m_occ.constData() + y * m_w;
+            quint8 *dst = base.data() + y * m_w;
+            for (int x = 1; x < m_w - 1; x++) {
+                const int n = qMax(qMax(row[x - 1], row[x + 1]), qMax(row[x - m_w], row[x + m_w]));
+                dst[x] = quint8(qMax(int(row[x]), n / 2));
+            }
+        }
+
+        for (int h = 1; h <= depth; h++) {
+            const int step = 1 << (h - 1);
+            const QVector<quint8> &src = m_grids[h - 1];
+            QVector<quint8> &dst = m_grids[h];
+            dst.resize(m_w * m_h);
+            for (int y = 0; y < m_h; y++) {
+                const bool down = y + step < m_h;
+                for (int x = 0; x < m_w; x++) {
+                    const bool right = x + step < m_w;
+                    const int i = y * m_w + x;
+                    int v = src[i];
+                    if (right)
+                        v = qMax(v, int(src[i + step]));
+                    if (down)
+                        v = qMax(v, int(src[i + step * m_w]));
+                    if (right && down)
+                        v = qMax(v, int(src[i + step * m_w + step]));
+                    dst[i] = quint8(v);
+                }
+            }
+        }
+    }
+
+    int score(const Job &job, int h, int ox, int oy) const {
+        const quint8 *grid = m_grids[h].constData() + oy * m_w + ox;
+        const int *index = job.index.constData();
+        const int count = job.index.size();
+        int sum = 0;
+        for (int i = 0; i < count; i++)
+            sum += grid[index[i]];
+        return sum;
+    }
+
+    void searchAngle(Job &job, int depth, int wc) {
+        const int step = 1 << depth;
+        job.roots.resize(0);
+        for (int oy = -wc; oy <= wc; oy += step)
+            for (int ox = -wc; ox <= wc; ox += step)
+                job.roots.append(Candidate{ox, oy, score(job, depth, ox, oy)});
+        std::sort(job.roots.begin(), job.roots.end(), [](const Candidate &a, const Candidate &b) {
+            return a.score > b.score;
+        });
+        for (const Candidate &root : qAsConst(job.roots))
+            branch(job, depth, wc, root);
+    }
+
+    void branch(const Job &job, int h, int wc, const Candidate &c) {
+        if (c.score <= m_bestScore.load(std::memory_order_relaxed))
+            return;
+        if (h == 0) {
+            QMutexLocker locker(&m_bestMtx);
+            if (c.score > m_bestScore.load(std::memory_order_relaxed)) {
+                m_bestScore = c.score;
+                m_bestTheta = job.theta;
+                m_bestOx = c.ox;
+                m_bestOy = c.oy;
+                m_found = true;
+            }
+            return;
+        }
+
+        const int step = 1 << (h - 1);
+        Candidate kids[4];
+        int n = 0;
+        for (int dy = 0; dy <= step; dy += step) {
+            for (int dx = 0; dx <= step; dx += step) {
+                const int ox = c.ox + dx, oy = c.oy + dy;
+                if (ox > wc || oy > wc)
+                    continue;
+                kids[n++] = Candidate{ox, oy, score(job, h - 1, ox, oy)};
+            }
+        }
+        for (int i = 1; i < n; i++) {
+            for (int j = i; j > 0 && kids[j].score > kids[j - 1].score; j--)
+                std::swap(kids[j], kids[j - 1]);
+        }
+        for (int i = 0; i < n; i++)
+            branch(job, h - 1, wc, kids[i]);
+    }
+
+    bool occupiedAt(int x, int y) const {
+        return x >= 0 && y >= 0 && x < m_w && y < m_h && m_occ[y * m_w + x] >= 128;
+    }
+
+    // Point-to-line Gauss-Newton over (x, y, theta).
+    void refine(Result &result, const QPointF *points, int count) {
+        CPose2D pose = result.pose;
+        const int gate = qMax(1, int(std::ceil(m_opt.icpMaxDist / m_cell)));
+        const double inv = 1.0 / m_cell;
+        int pairs = 0;
+
+        for (int iter = 0; iter < m_opt.icpIterations; iter++) {
+            double A[3][3] = {{0}}, b[3] = {0};
+            pairs = 0;
+            const double c = std::cos(pose.theta), s = std::sin(pose.theta);
+
+            for (int i = 0; i < count; i++) {
+                const double px = points[i].x(), py = points[i].y();
+                const double wx = pose.x + c * px - s * py;
+                const double wy = pose.y + s * px + c * py;
+                const int cx = int(std::floor(wx * inv)) - m_x0;
+                const int cy = int(std::floor(wy * inv)) - m_y0;
+
+                int qx = 0, qy = 0, best = INT_MAX;
+                for (int y = cy - gate; y <= cy + gate; y++) {
+                    for (int x = cx - gate; x <= cx + gate; x++) {
+                        const int d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                        if (d2 < best && occupiedAt(x, y)) {
+                            best = d2;
+                            qx = x;
+                            qy = y;
+                        }
+                    }
+                }
+                if (best == INT_MAX)
+                    continue;
+
+                double nx, ny;
+                if (!lineNormal(qx, qy, nx, ny))
+                    continue;
+
+                const double mx = (qx + m_x0 + 0.5) * m_cell;
+                const double my = (qy + m_y0 + 0.5) * m_cell;
+                const double r = nx * (wx - mx) + ny * (wy - my);
+                const double J[3] = { nx, ny, nx * (-s * px - c * py) + ny * (c * px - s * py) };
+                for (int row = 0; row < 3; row++) {
+                    for (int col = 0; col < 3; col++)
+                        A[row][col] += J[row] * J[col];
+                    b[row] += J[row] * r;
+                }
+                pairs++;
+            }
+            if (pairs < MinPoints)
+                return;
+
+            double d[3];
+            if (!solve3(A, b, d))
+                return;
+            pose.x -= d[0];
+            pose.y -= d[1];
+            pose.theta = CPose2D::normalizeAngle(pose.theta - d[2]);
+            if (std::fabs(d[0]) + std::fabs(d[1]) < 1e-4 && std::fabs(d[2]) < 1e-4)
+                break;
+        }
+
+        // ICP only polishes the search result; a jump beyond a couple of
+        // cells means it locked onto the wrong structure.
+        const double dx = pose.x - result.pose.x, dy = pose.y - result.pose.y;
+        if (dx * dx + dy * dy < 4.0 * m_cell * m_cell) {
+            result.pose = pose;
+            result.icpPairs = pairs;
+        }
+    }
+
+    // Normal of the line through the occupied cells around (x, y).
+    bool lineNormal(int x, int y, double &nx, double &ny) const {
+        double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        int n = 0;
+        for (int v = y - 2; v <= y + 2; v++) {
+            for (int u = x - 2; u <= x + 2; u++) {
+                if (!occupiedAt(u, v))
+                    continue;
+                sx += u; sy += v;
+                sxx += u * u; syy += v * v; sxy += u * v;
+                n++;
+            }
+        }
+        if (n < 3)
+            return false;
+        const double mx = sx / n, my = sy / n;
+        const double cxx = sxx / n - mx * mx;
+        const double cyy = syy / n - my * my;
+        const double cxy = sxy / n - mx * my;
+        const double phi = 0.5 * std::atan2(2.0 * cxy, cxx - cyy);
+        nx = -std::sin(phi);
+        ny = std::cos(phi);
+        return true;
+    }
+
+    static bool solve3(const double A[3][3], const double b[3], double x[3]) {
+        const double det =
+            A[0][0] * (A[1][1] * A[2][2] - A[1][2] * A[2][1]) -
+            A[0][1] * (A[1][0] * A[2][2] - A[1][2] * A[2][0]) +
+            A[0][2] * (A[1][0] * A[2][1] - A[1][1] * A[2][0]);
+        if (std::fabs(det) < 1e-12)
+            return false;
+        for (int k = 0; k < 3; k++) {
+            double M[3][3];
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++)
+                    M[r][c] = (c == k) ? b[r] : A[r][c];
+            x[k] = (M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1]) -
+                    M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0]) +
+                    M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0])) / det;
+        }
+        return true;
+    }
+};
+
+#endif // CSCANMATCHER_H
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANSEGMENTER_H
+#define CSCANSEGMENTER_H
+
+#include <QtCore/QVector>
+#include <QtCore/QPointF>
+#include <QtCore/QRectF>
+#include <QtCore/QtMath>
+#include <QtCore/QtNumeric>
+#include <cmath>
+
+#include "CScan.h"
+
+// Splits an angularly ordered scan into clusters in one pass. Two neighbouring
+// returns belong to the same object when their distance stays under an
+// adaptive breakpoint that grows with range and beam spacing:
+//   Dmax = r * sin(dphi) / sin(lambda - dphi) + 3 * sigma
+// Reads the scan's angle, range and x/y channels; output is meters in the
+// sensor frame.
+class CScanSegmenter {
+public:
+    struct Options {
+        double lambda = qDegreesToRadians(10.0);  // worst incidence angle kept together
+        double sigma = 0.01;                       // range noise, m
+        double minRange = 0.02;                    // shorter returns are dropouts
+        double maxRange = 60.0;
+        int    minPoints = 3;                      // smaller clusters are dropped as noise
+    };
+    struct Cluster {
+        int first = 0;      // record index of the first point
+        int last = 0;       // record index of the last point, inclusive; less than first when wrapping
+        int count = 0;
+        QPointF centroid;
+        QRectF bounds;
+    };
+
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+
+    const QVector<Cluster> &clusters() const { return m_clusters; }
+    // Cartesian points by record index; dropped returns are NaN.
+    const QVector<QPointF> &points() const { return m_points; }
+
+    const QVector<Cluster> &segment(const CScan &scan)
+    {
+        const int count = scan.size();
+        const float *angles = scan.angle();
+        const float *ranges = scan.range();
+        const float *x = scan.x();
+        const float *y = scan.y();
+        m_clusters.resize(0);
+        m_points.resize(count);
+        const double lambda = m_options.lambda;
+        const double noise = 3.0 * m_options.sigma;
+
+        Acc acc;
+        int prev = -1;
+        double prevAngle = 0.0, prevRange = 0.0, firstAngle = 0.0;
+        QPointF prevPoint, firstPoint;
+        for (int i = 0; i < count; i++) {
+            const double range = ranges[i] / 1000.0;
+            if (!(range >= m_options.minRange && range <= m_options.maxRange)) {
+                m_points[i] = QPointF(qQNaN(), qQNaN());
+                continue;
+            }
+            const double angle = qDegreesToRadians(double(angles[i]));
+            const QPointF point(x[i], y[i]);
+            m_points[i] = point;
+
+            if (prev < 0) {
+                firstAngle = angle;
+                firstPoint = point;
+            }
+            else if (!joins(prevRange, angle - prevAngle, prevPoint, point, lambda, noise)) {
+                m_clusters.append(acc.cluster());
+                acc = Acc();
+            }
+            acc.add(i, point);
+            prev = i;
+            prevAngle = angle;
+            prevRange = range;
+            prevPoint = point;
+        }
+        if (acc.count == 0)
+            return m_clusters;
+        m_clusters.append(acc.cluster());
+
+        // A full revolution closes on itself: the last cluster may continue the first.
+        if (m_clusters.size() > 1
+                && joins(prevRange, firstAngle - prevAngle, prevPoint, firstPoint, lambda, noise)) {
+            Cluster &head = m_clusters.first();
+            const Cluster &tail = m_clusters.last();
+            const int total = head.count + tail.count;
+            head.centroid = (head.centroid * head.count + tail.centroid * tail.count) / total;
+            head.bounds = head.bounds.united(tail.bounds);
+            head.first = tail.first;
+            head.count = total;
+            m_clusters.removeLast();
+        }
+
+        int kept = 0;
+        for (int i = 0; i < m_clusters.size(); i++) {
+            if (m_clusters[i].count >= m_options.minPoints)
+                m_clusters[kept++] = m_clusters[i];
+        }
+        m_clusters.resize(kept);
+        return m_clusters;
+    }
+
+private:
+    struct Acc {
+        int first = 0, last = 0, count = 0;
+        double sx = 0.0, sy = 0.0;
+        double x0 = 0.0, y0 = 0.0, x1 = 0.0, y1 = 0.0;
+
+        void add(int index, const QPointF &p) {
+            if (count == 0) {
+                first = index;
+                x0 = x1 = p.x();
+                y0 = y1 = p.y();
+            }
+            last = index;
+            count++;
+            sx += p.x();
+            sy += p.y();
+            x0 = qMin(x0, p.x());
+            x1 = qMax(x1, p.x());
+            y0 = qMin(y0, p.y());
+            y1 = qMax(y1, p.y());
+        }
+        Cluster cluster() const {
+            Cluster c;
+            c.first = first;
+            c.last = last;
+            c.count = count;
+            c.centroid = QPointF(sx / count, sy / count);
+            c.bounds = QRectF(QPointF(x0, y0), QPointF(x1, y1));
+            return c;
+        }
+    };
+
+    static bool joins(double range, double dphi, const QPointF &a, const QPointF &b,
+                      double lambda, double noise)
+    {
+        dphi = std::fabs(std::remainder(dphi, 2.0 * M_PI));
+        if (dphi >= lambda)
+            return false;
+        const double dmax = range * std::sin(dphi) / std::sin(lambda - dphi) + noise;
+        const QPointF d = b - a;
+        return d.x() * d.x() + d.y() * d.y() <= dmax * dmax;
+    }
+
+    Options m_options;
+    QVector<Cluster> m_clusters;
+    QVector<QPointF> m_points;
+};
+
+#endif // CSCANSEGMENTER_H
@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSCANSERVER_H
+#define CSCANSERVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QQueue>
+#include <QtCore/QVector>
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+#include <cstring>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include "CLineExtractor.h"
+#include "CScan.h"
+
+// Re-broadcasts decoded scans to downstream viewers over TCP.
+// Each scan is encoded once and the resulting (implicitly shared) frame is
+// queued to every client. Queues are bounded: when a client falls behind its
+// oldest frames are dropped, and a client that keeps overflowing is cut off.
+class CScanServer : public QObject {
+    Q_OBJECT
+
+public:
+    enum class eFormat : unsigned int
+    {
+        raw = 0,        // big-endian (angle, distance) float pairs, same as the sensor stream
+        compact,        // delta-encoded frames, see encodeCompact()
+        lines,          // line segments instead of points, see encodeLines()
+    };
+
+    static constexpr int compactHeaderSize = 16;
+    static constexpr int linesHeaderSize = 16;
+    static constexpr quint32 maxFramePayload = 64 * 1024 * 1024;   // decoders reject larger frames
+
+    CScanServer(QObject *parent = nullptr)
+        : QObject(parent), server(new QTcpServer(this))
+    {
+        QObject::connect(server, &QTcpServer::newConnection, this, &CScanServer::handleNewConn);
+    }
+    ~CScanServer() override {
+        stop();
+    }
+
+    bool start(quint16 port, const QHostAddress &addr = QHostAddress::Any) {
+        if (server->isListening())
+            stop();
+        return server->listen(addr, port);
+    }
+
+    void stop() {
+        server->close();
+        const QList<Client *> list = clients;
+        for (Client *client : list)
+            dropClient(client);
+    }
+
+    bool isListening() const {
+        return server->isListening();
+    }
+
+    void setFormat(eFormat format) {
+        m_format = format;
+    }
+
+    eFormat format() const {
+        return m_format;
+    }
+
+    // queueLimit: frames buffered per client, maxDrops: consecutive overflows
+    // tolerated before the client is disconnected.
+    void setQueueLimit(int queueLimit, int maxDrops) {
+        m_queueLimit = qMax(1, queueLimit);
+        m_maxDrops = qMax(0, maxDrops);
+    }
+
+    int clientCount() const {
+        return clients.size();
+    }
+
+    quint32 droppedFrames() const {
+        return m_droppedFrames;
+    }
+
+    quint32 droppedClients() const {
+        return m_droppedClients;
+    }
+
+    void publish(const CScan &scan) {
+        if (clients.isEmpty() || scan.isEmpty() || m_format == eFormat::lines)
+            return;
+
+        QByteArray frame;
+        if (m_format == eFormat::compact)
+            encodeCompact(scan.angle(), scan.range(), scan.size(), m_seq, frame);
+        else
+            encodeRaw(scan.angle(), scan.range(), scan.size(), frame);
+        broadcast(frame);
+    }
+
+    // Sent only in lines format; publish() covers the point formats.
+    void publishLines(const CLineExtractor::Segment *segments, int count) {
+        if (clients.isEmpty() || m_format != eFormat::lines)
+            return;
+
+        QByteArray frame;
+        encodeLines(segments, count, m_seq, frame);
+        broadcast(frame);
+    }
+
+    // Big-endian (angle, distance) float pairs.
+    static void encodeRaw(const float *angle, const float *distance, int count, QByteArray &out) {
+        out.resize(count * 2 * int(sizeof(float)));
+        uchar *dst = reinterpret_cast<uchar *>(out.data());
+        for (int i = 0; i < count; i++, dst += 8) {
+            quint32 bits;
+            memcpy(&bits, &angle[i], sizeof(bits));
+            qToBigEndian(bits, dst);
+            memcpy(&bits, &distance[i], sizeof(bits));
+            qToBigEndian(bits, dst + 4);
+        }
+    }
+
+    // Compact frame:
+    //   ['L']['M'][version][0][seq u32][count u32][payload bytes u32]  (little-endian)
+    //   then per point zigzag varints of the delta to the previous point,
+    //   angle in 0.01 deg and distance in whole units.
+    static void encodeCompact(const float *angles, const float *distances, int count, quint32 seq, QByteArray &out) {
+        out.resize(compactHeaderSize + count * 2 * 5);
+        uchar *begin = reinterpret_cast<uchar *>(out.data());
+        uchar *p = begin + compactHeaderSize;
+
+        qint32 prevAngle = 0, prevDist = 0;
+        for (int i = 0; i < count; i++) {
+            qint32 angle = qRound(angles[i] * 100.0f);
+            qint32 dist = qRound(distances[i]);
+            p = putVarint(p, zigzag(angle - prevAngle));
+            p = putVarint(p, zigzag(dist - prevDist));
+            prevAngle = angle;
+            prevDist = dist;
+        }
+
+        const quint32 payload = quint32(p - begin - compactHeaderSize);
+        begin[0] = 'L';
+        begin[1] = 'M';
+        begin[2] = 1;
+        begin[3] = 0;
+        qToLittleEndian(seq, begin + 4);
+        qToLittleEndian(quint32(count), begin + 8);
+        qToLittleEndian(payload, begin + 12);
+        out.resize(int(p - begin));
+    }
+
+    // Decodes one compact frame from the front of data, appending its points to
+    // records. Returns the bytes consumed, 0 if the frame is incomplete or -1
+    // if data does not start with a valid frame. The header comes off the
+    // network, so count must fit the payload (two varints of at least one
+    // byte per point) before anything is reserved.
+    static int decodeCompact(const char *data, int size, QVector<float> &records, quint32 *seq = nullptr) {
+        if (size < compactHeaderSize)
+            return 0;
+        const uchar *begin = reinterpret_cast<const uchar *>(data);
+        if (begin[0] != 'L' || begin[1] != 'M' || begin[2] != 1)
+            return -1;
+        const quint32 count = qFromLittleEndian<quint32>(begin + 8);
+        const quint32 payload = qFromLittleEndian<quint32>(begin + 12);
+        if (payload > maxFramePayload || count > payload / 2)
+            return -1;
+        if (quint32(size - compactHeaderSize) < payload)
+            return 0;
+        if (seq)
+            *seq = qFromLittleEndian<quint32>(begin + 4);
+
+        const uchar *p = begin + compactHeaderSize;
+        const uchar *end = p + payload;
+        qint32 angle = 0, dist = 0;
+        records.reserve(records.size() + int(count) * 2);
+        for (quint32 i = 0; i < count; i++) {
+            quint32 v;
+            if (!(p = getVarint(p, end, v)))
+                return -1;
+            angle += unzigzag(v);
+            if (!(p = getVarint(p, end, v)))
+                return -1;
+            dist += unzigzag(v);
+            records.append(angle / 100.0f);
+            records.append(float(dist));
+        }
+        return compactHeaderSize + int(payload);
+    }
+
+    // Lines frame:
+    //   ['L']['S'][version][0][seq u32][count u32][payload bytes u32]  (little-endian)
+    //   then per segment zigzag varints of a - previous b and b - a in mm,
+    //   followed by the max error as a varint in 0.1 mm.
+    static void encodeLines(const CLineExtractor::Segment *segments, int count, quint32 seq, QByteArray &out) {
+        out.resize(linesHeaderSize + count * 5 * 5);
+        uchar *begin = reinterpret_cast<uchar *>(out.data());
+        uchar *p = begin + linesHeaderSize;
+
+        qint32 prevX = 0, prevY = 0;
+        for (int i = 0; i < count; i++) {
+            const CLineExtractor::Segment &segment = segments[i];
+            const qint32 ax = qRound(segment.a.x() * 1000.0), ay = qRound(segment.a.y() * 1000.0);
+            const qint32 bx = qRound(segment.b.x() * 1000.0), by = qRound(segment.b.y() * 1000.0);
+            p = putVarint(p, zigzag(ax - prevX));
+            p = putVarint(p, zigzag(ay - prevY));
+            p = putVarint(p, zigzag(bx - ax));
+            p = putVarint(p, zigzag(by - ay));
+            p = putVarint(p, quint32(qRound(segment.maxError * 10000.0f)));
+            prevX = bx;
+            prevY = by;
+        }
+
+        const quint32 payload = quint32(p - begin - linesHeaderSize);
+        begin[0] = 'L';
+        begin[1] = 'S';
+        begin[2] = 1;
+        begin[3] = 0;
+        qToLittleEndian(seq, begin + 4);
+        qToLittleEndian(quint32(count), begin + 8);
+        qToLittleEndian(payload, begin + 12);
+        out.resize(int(p - begin));
+    }
+
+    // Same contract as decodeCompact(), with five varints per segment; rms
+    // and count are not transmitted.
+    static int decodeLines(const char *data, int size, QVector<CLineExtractor::Segment> &segments, quint32 *seq = nullptr) {
+        if (size < linesHeaderSize)
+            return 0;
+        const uchar *begin = reinterpret_cast<const uchar *>(data);
+        if (begin[0] != 'L' || begin[1] != 'S' || begin[2] != 1)
+            return -1;
+        const quint32 count = qFromLittleEndian<quint32>(begin + 8);
+        const quint32 payload = qFromLittleEndian<quint32>(begin + 12);
+        if (payload > maxFramePayload || count > payload / 5)
+            return -1;
+        if (quint32(size - linesHeaderSize) < payload)
+            return 0;
+        if (seq)
+            *seq = qFromLittleEndian<quint32>(begin + 4);
+
+        const uchar *p = begin + linesHeaderSize;
+        const uchar *end = p + payload;
+        qint32 x = 0, y = 0;
+        segments.reserve(segments.size() + int(count));
+        for (quint32 i = 0; i < count; i++) {
+            quint32 v[5];
+            for (int k = 0; k < 5; k++) {
+                if (!(p = getVarint(p, end, v[k])))
+                    return -1;
+            }
+            CLineExtractor::Segment segment;
+            x += unzigzag(v[0]);
+            y += unzigzag(v[1]);
+            segment.a = QPointF(x / 1000.0, y / 1000.0);
+            x += unzigzag(v[2]);
+            y += unzigzag(v[3]);
+            segment.b = QPointF(x / 1000.0, y / 1000.0);
+            segment.maxError = v[4] / 10000.0f;
+            segments.append(segment);
+        }
+        return linesHeaderSize + int(payload);
+    }
+
+signals:
+    void onClients(int count);
+
+private:
+    struct Client {
+        QTcpSocket *socket;
+        QQueue<QByteArray> pending;
+        int drops = 0;
+    };
+
+    QTcpServer *server;
+    QList<Client *> clients;
+    eFormat m_format = eFormat::raw;
+    quint32 m_seq = 0;
+    int m_queueLimit = 8;
+    int m_maxDrops = 32;
+    qint64 m_highWater = 256 * 1024;
+    quint32 m_droppedFrames = 0;
+    quint32 m_droppedClients = 0;
+
+    void broadcast(const QByteArray &frame) {
+        m_seq++;
+        const QList<Client *> list = clients;
+        for (Client *client : list)
+            enqueue(client, frame);
+    }
+
+    void handleNewConn() {
+        while (QTcpSocket *socket = server->nextPendingConnection()) {
+            socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+            Client *client = new Client{socket};
+            clients.append(client);
+            QObject::connect(socket, &QTcpSocket::bytesWritten, this, [this, client]() {
+                pump(client);
+            });
+            QObject::connect(socket, &QTcpSocket::disconnected, this, [this, client]() {
+                removeClient(client);
+            });
+            emit onClients(clients.size());
+        }
+    }
+
+    void enqueue(Client *client, const QByteArray &frame) {
+        if (client->pending.size() >= m_queueLimit) {
+            client->pending.dequeue();
+            m_droppedFrames++;
+            if (++client->drops > m_maxDrops) {
+                m_droppedClients++;
+                dropClient(client);
+                return;
+            }
+        }
+        else {
+            client->drops = 0;
+        }
+        client->pending.enqueue(frame);
+        pump(client);
+    }
+
+    // Keeps at most m_highWater bytes inside the socket so stale frames are
+    // dropped from our queue rather than piling up in the kernel buffer.
+    void pump(Client *client) {
+        while (!client->pending.isEmpty() &&
+               client->socket->bytesToWrite() < m_highWater) {
+            client->socket->write(client->pending.dequeue());
+        }
+    }
+
+    void dropClient(Client *client) {
+        client->socket->abort();
+        removeClient(client);
+    }
+
+    void removeClient(Client *client) {
+        if (!clients.removeOne(client))
+            return;
+        client->socket->disconnect(this);
+        client->socket->deleteLater();
+        delete client;
+        emit onClients(clients.size());
+    }
+
+    static quint32 zigzag(qint32 v) {
+        return (quint32(v) << 1) ^ quint32(v >> 31);
+    }
+
+    static qint32 unzigzag(quint32 v) {
+        return qint32(v >> 1) ^ -qint32(v & 1);
+    }
+
+    static uchar *putVarint(uchar *p, quint32 v) {
+        while (v >= 0x80) {
+            *p++ = uchar(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = uchar(v);
+        return p;
+    }
+
+    static const uchar *getVarint(const uchar *p, const uchar *end, quint32 &v) {
+        v = 0;
+        for (int shift = 0; shift < 35 && p < end; shift += 7) {
+            uchar b = *p++;
+            v |= quint32(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return p;
+        }
+        return nullptr;
+    }
+};
+
+#endif // CSCANSERVER_H
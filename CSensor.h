@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSENSOR_H
+#define CSENSOR_H
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QMutex>
+#include <atomic>
+#include <memory>
+
+#include "CComm.h"
+#include "CClock.h"
+#include "CPose2D.h"
+#include "CScanFusion.h"
+#include "CPipeline.h"
+#include "CJobPool.h"
+#include "CDecoderRegistry.h"
+#include "CMetrics.h"
+
+// One LiDAR connection. Comm I/O stays on the owner's thread (the sockets
+// live there); each received buffer is decoded and transformed by the
+// sensor's extrinsic into the vehicle frame on the work pool, so sensors
+// decode in parallel with each other, then delivered back on the owner's
+// thread. Every receive is decoded, since the decoder carries split records
+// from one to the next; the points are collected until the angle wraps, and
+// each completed revolution is delivered as one scan. Scans that fall
+// behind are dropped, oldest first.
+class CSensor : public QObject {
+    Q_OBJECT
+
+public:
+    enum class eCommType { TCP, UDP, COM };
+
+    struct Stats {
+        quint64 bytes = 0;
+        quint64 receives = 0;
+        quint64 scans = 0;          // completed revolutions
+        quint64 points = 0;
+        quint64 dropped = 0;        // decoded scans skipped while delivery was behind
+        qint64  decodeNsecs = 0;    // total decode time, all receives
+    };
+
+    CSensor(int id, QObject *parent = nullptr)
+        : QObject(parent), m_id(id), m_pipeline(this)
+    {
+        m_pipeline.addStage("decode", [this](Job &job) {
+            return decode(job);
+        }, maxPending, CPipeline<Job>::eThread::pool, CPipeline<Job>::eFull::grow);
+        m_pipeline.addStage("deliver", [this](Job &job) {
+            emit scanReady(job.scan);
+            return true;
+        }, 1, CPipeline<Job>::eThread::main);
+        QObject::connect(&m_pollTimer, &QTimer::timeout, this, &CSensor::poll);
+    }
+    ~CSensor() override {
+        m_pipeline.close();
+        stop();
+    }
+
+    int id() const { return m_id; }
+
+    void setExtrinsic(const CPose2D &extrinsic) {
+        QMutexLocker locker(&m_mutex);
+        m_extrinsic = extrinsic;
+    }
+
+    bool start(eCommType type, const QString &connString, int connNum,
+               const QString &model = CDecoderRegistry::defaultModel()) {
+        stop();
+        m_decoder = CDecoderRegistry::create(model);
+        if (!m_decoder)
+            return false;
+        if (type == eCommType::TCP)
+            m_comm = new TCPComm(this, m_id);
+        else if (type == eCommType::UDP)
+            m_comm = new UDPComm(this, m_id);
+        else
+            m_comm = new SerialComm(this, m_id);
+        QObject::connect(m_comm, &Comm::onAlert, this, [this](Comm *, int alertCode, const QString msg) {
+            emit onAlert(this, alertCode, msg);
+        });
+        QObject::connect(m_comm, &Comm::onStatus, this, [this](Comm *, Comm::eStatus status) {
+            if (status == Comm::eStatus::connected)
+                m_reconnected = true;
+        });
+        if (!m_comm->setConnInfo(connString, connNum))
+            return false;
+        m_comm->setTimeout(true, connCheckInterval, true, false, false);
+        m_comm->setReconnect(true);
+        if (!m_comm->connect(commWaitFor))
+            return false;
+        m_pollTimer.start(pollInterval);
+        return true;
+    }
+
+    void stop() {
+        m_pollTimer.stop();
+        if (m_comm) {
+            if (!m_comm->isOnError())
+                m_comm->close(commWaitFor);
+            m_comm->deleteLater();
+            m_comm = nullptr;
+        }
+    }
+
+    bool isConnected() const {
+        return m_comm && m_comm->isConnected();
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.bytes = m_counters.bytes;
+        s.receives = m_counters.packets;
+        s.scans = m_counters.scans;
+        s.points = m_counters.points;
+        s.dropped = m_pipeline.dropped();
+        s.decodeNsecs = m_decodeNsecs;
+        return s;
+    }
+
+    const CMetricCounters &counters() const {
+        return m_counters;
+    }
+
+    int pending() const {
+        return m_pipeline.depth();
+    }
+
+signals:
+    void scanReady(const CScanFusion::Scan &scan);
+    void onAlert(CSensor *sender, int alertCode, const QString msg);
+
+private:
+    const int pollInterval = 10;
+    const int connCheckInterval = 200;
+    const quint32 commWaitFor = 1000;
+    const int maxPending = 2;       // initial decode queue; it grows rather than drop
+
+    // Recycled; buffers keep their capacity between scans.
+    struct Job {
+        QByteArray raw;
+        qint64 stamp = 0;
+        std::shared_ptr<CDecoder> decoder;
+        bool reconnected = false;   // first receive of a new connection
+        CScan decoded;
+        CScanFusion::Scan scan;
+
+        void reset() {
+            decoder.reset();
+            reconnected = false;
+            scan.points.resize(0);
+        }
+    };
+
+    int m_id;
+    Comm *m_comm = nullptr;
+    QTimer m_pollTimer;
+    QByteArray m_buff;
+
+    QMutex m_mutex;                 // m_extrinsic
+    CPose2D m_extrinsic;
+
+    std::shared_ptr<CDecoder> m_decoder;
+    bool m_reconnected = false;
+
+    // Decode stage only: vehicle-frame points of the revolution in progress.
+    QVector<QPointF> m_revolution;
+    float m_lastAngle = qQNaN();
+
+    CMetricCounters m_counters;
+    std::atomic<qint64> m_decodeNsecs{0};
+
+    CJobPool<Job> m_jobs;
+    CPipeline<Job> m_pipeline;
+
+    void poll() {
+        if (!m_comm || !m_comm->isIdle() || !m_comm->inbox())
+            return;
+        if (!m_comm->recv(m_buff, IGNORE))
+            return;
+        CMetricCounters::add(m_counters.bytes, m_buff.size());
+        CMetricCounters::add(m_counters.packets);
+        CPipeline<Job>::JobPtr job = m_jobs.acquire();
+        job->raw.swap(m_buff);
+        job->stamp = m_comm->recvStamp();
+        job->decoder = m_decoder;
+        job->reconnected = m_reconnected;
+        m_reconnected = false;
+        m_pipeline.push(job);
+    }
+
+    // True if the receive completed a revolution, which job.scan then
+    // holds; of several, the last.
+    bool decode(Job &job) {
+        LUMO_TRACE("CSensor::decode");
+        const qint64 t0 = CClock::nsecs();
+        CPose2D extrinsic;
+        {
+            QMutexLocker locker(&m_mutex);
+            extrinsic = m_extrinsic;
+        }
+
+        if (job.reconnected) {
+            job.decoder->reset();
+            m_revolution.resize(0);
+            m_lastAngle = qQNaN();
+        }
+        job.decoder->decode(job.raw, job.decoded);
+        const CScan &decoded = job.decoded;
+        const float *angle = decoded.angle();
+        const float *x = decoded.x();
+        const float *y = decoded.y();
+        CScanFusion::Scan &scan = job.scan;
+        int revolutions = 0;
+        int points = 0;
+        for (int i = 0; i < decoded.size(); i++) {
+            if (CDecoder::wraps(m_lastAngle, angle[i])) {
+                // The job's buffer takes the next revolution, so neither
+                // side allocates once both have grown.
+                scan.points.swap(m_revolution);
+                m_revolution.resize(0);
+                revolutions++;
+            }
+            m_lastAngle = angle[i];
+            if (!qIsNaN(x[i])) {
+                m_revolution.append(extrinsic.map(QPointF(x[i], y[i])));
+                points++;
+            }
+        }
+        scan.sensor = m_id;
+        scan.stamp = job.stamp;
+
+        if (decoded.isEmpty())
+            CMetricCounters::add(m_counters.partialReceives);
+        CMetricCounters::add(m_counters.scans, revolutions);
+        CMetricCounters::add(m_counters.points, points);
+        m_decodeNsecs += CClock::nsecs() - t0;
+        return revolutions > 0;
+    }
+};
+
+#endif // CSENSOR_H
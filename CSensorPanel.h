@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CSENSORPANEL_H
+#define CSENSORPANEL_H
+
+#include <QtWidgets>
+
+#include "CSensor.h"
+#include "CMetrics.h"
+
+// Dock listing the additional sensors: connection, extrinsic (x, y in m,
+// yaw in deg) and per-sensor throughput refreshed once a second.
+class CSensorPanel : public QDockWidget {
+    Q_OBJECT
+
+public:
+    enum eColumn { colType = 0, colAddr, colNum, colX, colY, colYaw, colConnect,
+                   colScans, colPoints, colKBytes, colDecode, colDropped, colCount };
+
+    CSensorPanel(QWidget *parent = nullptr)
+        : QDockWidget("Sensors", parent)
+    {
+        QWidget *body = new QWidget(this);
+        QVBoxLayout *layout = new QVBoxLayout(body);
+        table = new QTableWidget(0, colCount, body);
+        table->setHorizontalHeaderLabels({"Type", "Address", "Port/Baud", "X (m)", "Y (m)", "Yaw (deg)", "On",
+                                          "Scans/s", "Points/s", "KB/s", "Decode ms", "Dropped"});
+        table->verticalHeader()->setVisible(false);
+        table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        layout->addWidget(table);
+
+        QHBoxLayout *buttons = new QHBoxLayout();
+        QPushButton *btnAdd = new QPushButton("Add", body);
+        QPushButton *btnRemove = new QPushButton("Remove", body);
+        buttons->addWidget(btnAdd);
+        buttons->addWidget(btnRemove);
+        buttons->addStretch();
+        layout->addLayout(buttons);
+        setWidget(body);
+
+        QObject::connect(btnAdd, &QPushButton::clicked, this, &CSensorPanel::addSensor);
+        QObject::connect(btnRemove, &QPushButton::clicked, this, [this]() {
+            removeSensor(table->currentRow());
+        });
+        QObject::connect(table, &QTableWidget::itemChanged, this, &CSensorPanel::handleItemChanged);
+        QObject::connect(&statsTimer, &QTimer::timeout, this, &CSensorPanel::updateStats);
+        statsTimer.start(statsInterval);
+    }
+
+    int count() const {
+        return rows.size();
+    }
+
+    // Sensors added from now on report to metrics.
+    void setMetrics(CMetrics *metrics) {
+        m_metrics = metrics;
+    }
+
+signals:
+    void scanReady(const CScanFusion::Scan &scan);
+    void sensorRemoved(int id);
+    void onAlert(CSensor *sender, int alertCode, const QString msg);
+
+private:
+    struct Row {
+        CSensor *sensor;
+        CSensor::Stats last;
+    };
+
+    QTableWidget *table;
+    QList<Row> rows;
+    QTimer statsTimer;
+    QElapsedTimer statsClock;
+    int m_nextId = 1;       // 0 is the toolbar connection
+    CMetrics *m_metrics = nullptr;
+    const int statsInterval = 1000;
+
+    void addSensor() {
+        CSensor *sensor = new CSensor(m_nextId++, this);
+        QObject::connect(sensor, &CSensor::scanReady, this, &CSensorPanel::scanReady);
+        QObject::connect(sensor, &CSensor::onAlert, this, &CSensorPanel::onAlert);
+        rows.append(Row{sensor, CSensor::Stats()});
+        if (m_metrics) {
+            CMetrics::Source source;
+            source.id = sensor->id();
+            source.name = "Sensor " + QString::number(sensor->id());
+            source.counters = &sensor->counters();
+            source.dropped = [sensor]() { return sensor->stats().dropped; };
+            source.depth = [sensor]() { return sensor->pending(); };
+            m_metrics->addSource(source);
+        }
+
+        const int row = table->rowCount();
+        const QSignalBlocker blocker(table);
+        table->insertRow(row);
+        QComboBox *type = new QComboBox(table);
+        type->addItems({"TCP", "UDP", "COM"});
+        table->setCellWidget(row, colType, type);
+        table->setItem(row, colAddr, new QTableWidgetItem("127.0.0.1"));
+        table->setItem(row, colNum, new QTableWidgetItem(QString::number(45454 + row + 1)));
+        for (int col : {colX, colY, colYaw})
+            table->setItem(row, col, new QTableWidgetItem("0"));
+        QTableWidgetItem *on = new QTableWidgetItem();
+        on->setFlags(Qt::ItemIsUserCheckable | Qt::ItemIsEnabled);
+        on->setCheckState(Qt::Unchecked);
+        table->setItem(row, colConnect, on);
+        for (int col = colScans; col < colCount; col++) {
+            QTableWidgetItem *item = new QTableWidgetItem("-");
+            item->setFlags(Qt::ItemIsEnabled);
+            table->setItem(row, col, item);
+        }
+    }
+
+    void removeSensor(int row) {
+        if (row < 0 || row >= rows.size())
+            return;
+        CSensor *sensor = rows.takeAt(row).sensor;
+        table->removeRow(row);
+        emit sensorRemoved(sensor->id());
+        if (m_metrics)
+            m_metrics->removeSource(sensor->id());
+        delete sensor;
+    }
+
+    void handleItemChanged(QTableWidgetItem *item) {
+        const int row = item->row();
+        if (row < 0 || row >= rows.size())
+            return;
+        CSensor *sensor = rows[row].sensor;
+        if (item->column() >= colX && item->column() <= colYaw) {
+            sensor->setExtrinsic(CPose2D(table->item(row, colX)->text().toDouble(),
+                                         table->item(row, colY)->text().toDouble(),
+                                         qDegreesToRadians(table->item(row, colYaw)->text().toDouble())));
+        }
+        else if (item->column() == colConnect) {
+            const bool on = item->checkState() == Qt::Checked;
+            QComboBox *type = qobject_cast<QComboBox *>(table->cellWidget(row, colType));
+            setConnEditable(row, !on);
+            if (!on) {
+                sensor->stop();
+                emit sensorRemoved(sensor->id());
+            }
+            else if (!sensor->start(CSensor::eCommType(type->currentIndex()),
+                                    table->item(row, colAddr)->text(),
+                                    table->item(row, colNum)->text().toInt())) {
+                const QSignalBlocker blocker(table);
+                item->setCheckState(Qt::Unchecked);
+                setConnEditable(row, true);
+                emit onAlert(sensor, 0, "Sensor " + QString::number(sensor->id()) + " Connecting Failed.");
+            }
+        }
+    }
+
+    void setConnEditable(int row, bool editable) {
+        const QSignalBlocker blocker(table);
+        table->cellWidget(row, colType)->setEnabled(editable);
+        for (int col : {colAddr, colNum}) {
+            QTableWidgetItem *item = table->item(row, col);
+            item->setFlags(editable ? item->flags() | Qt::ItemIsEditable : item->flags() & ~Qt::ItemIsEditable);
+        }
+    }
+
+    void updateStats() {
+        const double seconds = statsClock.isValid() ? statsClock.restart() / 1000.0 : statsInterval / 1000.0;
+        if (!statsClock.isValid())
+            statsClock.start();
+        const QSignalBlocker blocker(table);
+        for (int row = 0; row < rows.size(); row++) {
+            const CSensor::Stats now = rows[row].sensor->stats();
+            const CSensor::Stats &last = rows[row].last;
+            const quint64 receives = now.receives - last.receives;
+            table->item(row, colScans)->setText(QString::number((now.scans - last.scans) / seconds, 'f', 1));
+            table->item(row, colPoints)->setText(QString::number(qRound((now.points - last.points) / seconds)));
+            table->item(row, colKBytes)->setText(QString::number((now.bytes - last.bytes) / 1024.0 / seconds, 'f', 1));
+            table->item(row, colDecode)->setText(receives ? QString::number((now.decodeNsecs - last.decodeNsecs) / 1e6 / receives, 'f', 3) : "-");
+            table->item(row, colDropped)->setText(QString::number(now.dropped));
+            rows[row].last = now;
+        }
+    }
+};
+
+#endif // CSENSORPANEL_H
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CTRACE_H
+#define CTRACE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "CClock.h"
+
+// Scoped hot-path markers, dumped as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev). Each thread writes complete events into its own ring,
+// so recording takes no lock; the ring keeps the latest Capacity events.
+// Disabled, a marker costs one relaxed load.
+//
+//   void decode() {
+//       LUMO_TRACE("decode");      // string literal: only the pointer is kept
+//       ...
+//   }
+class CTrace {
+public:
+    static const int Capacity = 16384;     // events per thread
+
+    static void setEnabled(bool enabled)
+    {
+        flag().store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool isEnabled()
+    {
+        return flag().load(std::memory_order_relaxed);
+    }
+
+    static void record(const char *name, qint64 begin, qint64 end)
+    {
+        Ring *ring = local();
+        const quint64 head = ring->head.load(std::memory_order_relaxed);
+        Event &event = ring->events[head % Capacity];
+        event.name = name;
+        event.begin = begin;
+        event.end = end;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    // Events still held by every thread's ring. Safe while threads keep
+    // recording; events overwritten during the copy are left out.
+    static QByteArray toJson()
+    {
+        QByteArray json = "{\"traceEvents\":[\n";
+        bool first = true;
+        auto append = [&](const QByteArray &line) {
+            if (!first)
+                json += ",\n";
+            json += line;
+            first = false;
+        };
+
+        Registry &registry = rings();
+        QMutexLocker locker(&registry.mutex);
+        for (const std::unique_ptr<Ring> &ring : registry.list) {
+            append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(ring->tid)
+                   + ",\"args\":{\"name\":\"" + ring->threadName + "\"}}");
+
+            const quint64 end = ring->head.load(std::memory_order_acquire);
+            const quint64 begin = end > quint64(Capacity) ? end - Capacity : 0;
+            std::vector<Event> events(ring->events + 0, ring->events + Capacity);
+            const quint64 after = ring->head.load(std::memory_order_acquire);
+            // Slots written since the first read, and the one being
+            // written now, may hold newer or half-written events.
+            const quint64 valid = after + 1 > quint64(Capacity) ? after + 1 - Capacity : 0;
+            for (quint64 i = qMax(begin, valid); i < end; i++) {
+                const Event &event = events[i % Capacity];
+                append("{\"name\":\"" + QByteArray(event.name) + "\",\"cat\":\"lumo\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                       + QByteArray::number(ring->tid)
+                       + ",\"ts\":" + QByteArray::number(event.begin / 1000.0, 'f', 3)
+                       + ",\"dur\":" + QByteArray::number((event.end - event.begin) / 1000.0, 'f', 3) + "}");
+            }
+        }
+        json += "\n]}\n";
+        return json;
+    }
+
+    static bool dump(const QString &path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        return file.write(toJson()) >= 0;
+    }
+
+private:
+    struct Event {
+        const char *name = nullptr;
+        qint64 begin = 0;
+        qint64 end = 0;
+    };
+
+    struct Ring {
+        std::atomic<quint64> head{0};
+        int tid = 0;
+        QByteArray threadName;
+        Event events[Capacity];
+    };
+
+    // Rings outlive their threads so a dump still shows finished work.
+    struct Registry {
+        QMutex mutex;
+        std::vector<std::unique_ptr<Ring>> list;
+    };
+
+    static std::atomic<bool> &flag()
+    {
+        static std::atomic<bool> enabled{false};
+        return enabled;
+    }
+
+    static Registry &rings()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    // First use on a thread registers its ring, the only locked step.
+    static Ring *local()
+    {
+        static thread_local Ring *ring = nullptr;
+        if (!ring) {
+            std::unique_ptr<Ring> created(new Ring());
+            QThread *thread = QThread::currentThread();
+            Registry &registry = rings();
+            QMutexLocker locker(&registry.mutex);
+            created->tid = int(registry.list.size()) + 1;
+            created->threadName = (thread && !thread->objectName().isEmpty())
+                    ? thread->objectName().toUtf8()
+                    : "Thread " + QByteArray::number(created->tid);
+            ring = created.get();
+            registry.list.push_back(std::move(created));
+        }
+        return ring;
+    }
+};
+
+class CTraceScope {
+public:
+    explicit CTraceScope(const char *name)
+        : m_name(CTrace::isEnabled() ? name : nullptr),
+          m_begin(m_name ? CClock::nsecs() : 0)
+    {
+    }
+    ~CTraceScope()
+    {
+        if (m_name)
+            CTrace::record(m_name, m_begin, CClock::nsecs());
+    }
+
+private:
+    const char *m_name;
+    qint64 m_begin;
+};
+
+#define LUMO_TRACE_CONCAT2(a, b) a##b
+#define LUMO_TRACE_CONCAT(a, b) LUMO_TRACE_CONCAT2(a, b)
+#define LUMO_TRACE(name) CTraceScope LUMO_TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // CTRACE_H
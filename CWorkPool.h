@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CWORKPOOL_H
+#define CWORKPOOL_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QThread>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. A task posted from a
+// worker goes to that worker's deque and is popped LIFO while it is still
+// warm; a task posted from elsewhere is spread round-robin. An idle worker
+// steals the oldest task of another before going to sleep.
+class CWorkPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit CWorkPool(int threads = QThread::idealThreadCount())
+    {
+        threads = qMax(1, threads);
+        for (int i = 0; i < threads; i++)
+            m_workers.emplace_back(new Worker());
+        for (int i = 0; i < threads; i++)
+            m_workers[i]->thread = std::thread(&CWorkPool::run, this, i);
+    }
+    ~CWorkPool()
+    {
+        {
+            QMutexLocker locker(&m_sleepMutex);
+            m_stop = true;
+            m_wake.wakeAll();
+        }
+        for (auto &worker : m_workers)
+            worker->thread.join();
+    }
+
+    static CWorkPool &global()
+    {
+        static CWorkPool pool;
+        return pool;
+    }
+
+    void post(Task task)
+    {
+        int index = (currentPool() == this) ? currentIndex() : int(m_next++ % m_workers.size());
+        Worker &worker = *m_workers[index];
+        {
+            QMutexLocker locker(&worker.mutex);
+            worker.tasks.pushBack(std::move(task));
+        }
+        m_queued++;
+        QMutexLocker locker(&m_sleepMutex);
+        m_wake.wakeOne();
+    }
+
+    // Runs fn(i) for every i in [0, count) and returns when all are done.
+    // The caller works through the indices too, so this is safe to call from
+    // inside a pool task, and then sleeps until helpers still inside fn
+    // finish. A helper that starts after the indices ran out returns at once.
+    void parallelFor(int count, const std::function<void(int)> &fn)
+    {
+        Batch *batch = acquireBatch();
+        batch->body = &fn;
+        batch->count = count;
+        batch->next = 0;
+        const int helpers = qMax(0, qMin(threadCount(), count) - 1);
+        batch->refs = helpers + 1;
+        for (int i = 0; i < helpers; i++) {
+            post([this, batch]() {
+                batch->help();
+                releaseBatch(batch);
+            });
+        }
+        batch->help();
+        {
+            QMutexLocker locker(&batch->mutex);
+            while (batch->running > 0)
+                batch->idle.wait(&batch->mutex);
+        }
+        releaseBatch(batch);
+    }
+
+    int threadCount() const { return int(m_workers.size()); }
+    int queued() const { return m_queued; }
+    quint64 steals() const { return m_steals; }
+
+private:
+    // Double-ended ring that only grows, so steady posting does not allocate.
+    class Deque {
+    public:
+        bool empty() const { return m_count == 0; }
+        void pushBack(Task &&task)
+        {
+            if (m_count == int(m_slots.size()))
+                grow();
+            m_slots[(m_head + m_count++) % m_slots.size()] = std::move(task);
+        }
+        Task popBack()
+        {
+            return take((m_head + --m_count) % m_slots.size());
+        }
+        Task popFront()
+        {
+            const int slot = m_head;
+            m_head = (m_head + 1) % m_slots.size();
+            m_count--;
+            return take(slot);
+        }
+
+    private:
+        std::vector<Task> m_slots = std::vector<Task>(16);
+        int m_head = 0, m_count = 0;
+
+        Task take(int slot)
+        {
+            Task task = std::move(m_slots[slot]);
+            m_slots[slot] = nullptr;
+            return task;
+        }
+        void grow()
+        {
+            std::vector<Task> bigger(m_slots.size() * 2);
+            for (int i = 0; i < m_count; i++)
+                bigger[i] = std::move(m_slots[(m_head + i) % m_slots.size()]);
+            m_slots.swap(bigger);
+            m_head = 0;
+        }
+    };
+
+    struct Worker {
+        QMutex mutex;
+        Deque tasks;
+        std::thread thread;
+    };
+
+    // State shared by one parallelFor call and its helpers. Batches are
+    // recycled once the last helper lets go, so calls do not allocate.
+    struct Batch {
+        const std::function<void(int)> *body = nullptr;
+        int count = 0;
+        std::atomic<int> next{0};
+        std::atomic<int> running{0};    // threads inside help()
+        std::atomic<int> refs{0};       // caller and helpers not yet released
+        QMutex mutex;
+        QWaitCondition idle;
+
+        void help()
+        {
+            running++;
+            for (int i; (i = next++) < count;)
+                (*body)(i);
+            if (--running == 0) {
+                QMutexLocker locker(&mutex);
+                idle.wakeAll();
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    QMutex m_sleepMutex;
+    QWaitCondition m_wake;
+    std::atomic<int> m_queued{0};
+    std::atomic<unsigned> m_next{0};
+    std::atomic<quint64> m_steals{0};
+    bool m_stop = false;
+    QMutex m_batchMutex;
+    std::vector<std::unique_ptr<Batch>> m_batches;
+    std::vector<Batch *> m_freeBatches;
+
+    // Pool and worker index of the calling thread.
+    static CWorkPool *&currentPool()
+    {
+        static thread_local CWorkPool *pool = nullptr;
+        return pool;
+    }
+    static int &currentIndex()
+    {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    Batch *acquireBatch()
+    {
+        QMutexLocker locker(&m_batchMutex);
+        if (m_freeBatches.empty()) {
+            m_batches.emplace_back(new Batch());
+            m_freeBatches.reserve(m_batches.size());
+            return m_batches.back().get();
+        }
+        Batch *batch = m_freeBatches.back();
+        m_freeBatches.pop_back();
+        return batch;
+    }
+
+    void releaseBatch(Batch *batch)
+    {
+        if (--batch->refs > 0)
+            return;
+        QMutexLocker locker(&m_batchMutex);
+        m_freeBatches.push_back(batch);
+    }
+
+    void run(int index)
+    {
+        currentPool() = this;
+        currentIndex() = index;
+        QThread::currentThread()->setObjectName("Pool " + QString::number(index));
+        Task task;
+        for (;;) {
+            if (pop(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            QMutexLocker locker(&m_sleepMutex);
+            if (m_stop)
+                return;
+            if (m_queued == 0)
+                m_wake.wait(&m_sleepMutex);
+        }
+    }
+
+    bool pop(int index, Task &task)
+    {
+        {
+            Worker &own = *m_workers[index];
+            QMutexLocker locker(&own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.popBack();
+                m_queued--;
+                return true;
+            }
+        }
+        const int count = int(m_workers.size());
+        for (int i = 1; i < count; i++) {
+            Worker &victim = *m_workers[(index + i) % count];
+            QMutexLocker locker(&victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.popFront();
+                m_queued--;
+                m_steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // CWORKPOOL_H
@@ -0,0 +1,19 @@
+# Builds the core library and everything on top of it:
+#   core     transports, decoders, storage and processing (QtCore/QtNetwork)
+#   app      the viewer (CLumoMap.pro)
+#   daemon   headless ingest for edge boxes and soak tests
+#   bench    hot path benchmarks
+#   tests    transport and pipeline tests, run with "make check"
+TEMPLATE = subdirs
+
+SUBDIRS += core app daemon bench tests
+
+core.file = core/LumoCore.pro
+app.file = CLumoMap.pro
+app.makefile = Makefile.app
+app.depends = core
+daemon.file = daemon/LumoDaemon.pro
+daemon.depends = core
+bench.file = bench/CLumoBench.pro
+bench.depends = core
+tests.depends = core
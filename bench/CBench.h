@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CBENCH_H
+#define CBENCH_H
+
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QtMath>
+#include <algorithm>
+
+#include "CClock.h"
+#include "CSimd.h"
+
+// Times one operation per case. The iteration count is doubled until a
+// batch runs for at least batchNsecs, then several batches are timed and
+// the median is reported, so one slow batch does not move the result.
+// The report is JSON with a fixed key order and one entry per case in run
+// order, so runs from different commits can be diffed directly.
+class CBench {
+public:
+    struct Result {
+        QString name;
+        int points = 0;
+        qint64 iterations = 0;
+        double nsPerOp = 0;         // median batch
+        double minNsPerOp = 0;      // fastest batch
+    };
+
+    explicit CBench(const QString &filter = QString(), qint64 batchNsecs = 20000000, int batches = 7)
+        : m_filter(filter), m_batchNsecs(batchNsecs), m_batches(batches)
+    {
+    }
+
+    template <class Op>
+    void run(const QString &name, int points, Op op)
+    {
+        if (!m_filter.isEmpty() && !name.contains(QRegularExpression(m_filter)))
+            return;
+        op();
+        qint64 iterations = 1;
+        while (time(op, iterations) < m_batchNsecs && iterations < (qint64(1) << 30))
+            iterations *= 2;
+
+        QVector<double> perOp;
+        for (int b = 0; b < m_batches; b++)
+            perOp.append(double(time(op, iterations)) / iterations);
+        std::sort(perOp.begin(), perOp.end());
+
+        Result result;
+        result.name = name;
+        result.points = points;
+        result.iterations = iterations;
+        result.nsPerOp = perOp[perOp.size() / 2];
+        result.minNsPerOp = perOp.first();
+        m_results.append(result);
+    }
+
+    const QVector<Result> &results() const { return m_results; }
+
+    QByteArray report() const
+    {
+        QJsonArray cases;
+        for (const Result &result : m_results) {
+            QJsonObject entry;
+            entry["name"] = result.name;
+            entry["points"] = result.points;
+            entry["iterations"] = result.iterations;
+            entry["ns_per_op"] = round(result.nsPerOp);
+            entry["min_ns_per_op"] = round(result.minNsPerOp);
+            entry["ns_per_point"] = round(result.points ? result.nsPerOp / result.points : 0);
+            cases.append(entry);
+        }
+        QJsonObject root;
+        root["schema"] = 1;
+        root["qt"] = QString(qVersion());
+#ifdef LUMO_SSE2
+        root["simd"] = QString("sse2");
+#else
+        root["simd"] = QString("none");
+#endif
+        root["results"] = cases;
+        return QJsonDocument(root).toJson(QJsonDocument::Indented);
+    }
+
+    // Keeps a result the compiler could otherwise prove unused.
+    static void keep(const void *p)
+    {
+        static const void *volatile sink;
+        sink = p;
+    }
+
+private:
+    QString m_filter;
+    qint64 m_batchNsecs;
+    int m_batches;
+    QVector<Result> m_results;
+
+    template <class Op>
+    static qint64 time(Op &op, qint64 iterations)
+    {
+        const qint64 t0 = CClock::nsecs();
+        for (qint64 i = 0; i < iterations; i++)
+            op();
+        return CClock::nsecs() - t0;
+    }
+
+    static double round(double v) { return qRound64(v * 10) / 10.0; }
+};
+
+#endif // CBENCH_H
@@ -0,0 +1,18 @@
+# Benchmarks for the ingestion, storage and rendering hot paths.
+# Built with the core library by LumosLiDARViewer.pro; from its shadow build
+# directory run bench/CLumoBench -o bench.json
+QT += core widgets gui
+CONFIG += console c++11
+CONFIG -= app_bundle
+TARGET = CLumoBench
+
+include(../core/LumoCore.pri)
+
+HEADERS += \
+    CBench.h \
+    ../CLumoMap.h
+
+SOURCES += \
+           ../CLumoMap.cpp \
+           main.cpp
+msvc: QMAKE_CXXFLAGS += /utf-8
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QImage>
+#include <cstdio>
+
+#include "CBench.h"
+#include "CDecoderRegistry.h"
+#include "CCloudPoints.h"
+#include "CLumoMap.h"
+#include "CScanFilter.h"
+#include "CScanSegmenter.h"
+#include "CLineExtractor.h"
+#include "CDeskew.h"
+#include "COccupancyGrid.h"
+#include "CScanMatcher.h"
+
+// Hot paths of the viewer at several scan sizes:
+//   decode/<model>          compiled decoder, one receive of whole records;
+//                           registered models and the test layouts
+//   decode-generic/<model>  same bytes through CGenericDecoder
+//   store/cloudpoints       CCloudPoints::setScan + getPoints (two revolutions kept)
+//   polar/xy                CScan angle/range -> x/y
+//   filter/scan             copy of the scan + CScanFilter::apply
+//   segment/scan            CScanSegmenter::segment
+//   lines/extract           CLineExtractor::extract of the segmented scan
+//   deskew/scan             CDeskew::apply with a timed scan and moving sensor
+//   grid/integrate          COccupancyGrid::integrate of the valid returns
+//   match/scan              CScanMatcher::match against a grid of the same room
+//   paint/lumomap           CLumoMap rendered into an offscreen image
+static const int pointCounts[] = { 360, 1200, 4800, 19200 };
+
+// Layouts only the bench decodes, so their paths are measured without being
+// offered as sensor models.
+namespace CBenchModel {
+
+// Test layout, not a known sensor format: ranges only, little-endian mm in
+// beam order from startAngle. Exercises the angle-less decode path.
+struct Range16 {
+    typedef CNoField Angle;
+    typedef quint16 Range;
+    static const bool bigEndian = false;
+    static const int beams = 1440;
+    static constexpr float angleScale() { return 1.0f; }
+    static constexpr float rangeScale() { return 1.0f; }
+    static constexpr float resolution() { return 0.25f; }
+    static constexpr float startAngle() { return 0.0f; }
+};
+
+// Test layout, not a known sensor format: little-endian (angle 0.01 deg,
+// range 0.25 mm) 16-bit pairs. Exercises scaled integer fields.
+struct Polar16 {
+    typedef quint16 Angle;
+    typedef quint16 Range;
+    static const bool bigEndian = false;
+    static const int beams = 720;
+    static constexpr float angleScale() { return 0.01f; }
+    static constexpr float rangeScale() { return 0.25f; }
+    static constexpr float resolution() { return 0.5f; }
+    static constexpr float startAngle() { return 0.0f; }
+};
+
+} // namespace CBenchModel
+
+struct Model {
+    QString name;
+    std::shared_ptr<CDecoder> decoder;
+};
+
+// Every registered model, then the test layouts.
+static QVector<Model> models()
+{
+    QVector<Model> list;
+    for (const CDecoderRegistry::Entry &entry : CDecoderRegistry::entries())
+        list.append(Model{ entry.model, CDecoderRegistry::create(entry.model) });
+    list.append(Model{ "test-range16", std::make_shared<CPacketDecoder<CBenchModel::Range16>>() });
+    list.append(Model{ "test-polar16", std::make_shared<CPacketDecoder<CBenchModel::Polar16>>() });
+    return list;
+}
+
+// A room-like outline with a dropout every 17 beams.
+static double rangeAt(int i, double angle)
+{
+    return (i % 17 == 16) ? 0.0 : 2500.0 + 800.0 * qSin(qDegreesToRadians(angle * 3));
+}
+
+static CScan scan(int count)
+{
+    CScan s;
+    s.resize(count);
+    float *angle = s.angle();
+    float *range = s.range();
+    for (int i = 0; i < count; i++) {
+        angle[i] = 360.0f * i / count;
+        range[i] = float(rangeAt(i, angle[i]));
+    }
+    return s;
+}
+
+// Valid returns in meters, sensor frame.
+static QVector<QPointF> hits(const CScan &s)
+{
+    QVector<QPointF> points;
+    const float *x = s.x();
+    const float *y = s.y();
+    for (int i = 0; i < s.size(); i++) {
+        if (!qIsNaN(x[i]))
+            points.append(QPointF(x[i], y[i]));
+    }
+    return points;
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("LumosLiDARViewer hot path benchmarks");
+    parser.addHelpOption();
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report to <file>.", "file");
+    QCommandLineOption filterOption({"f", "filter"}, "Run only cases whose name matches <regex>.", "regex");
+    parser.addOption(outputOption);
+    parser.addOption(filterOption);
+    parser.process(app);
+
+    CBench bench(parser.value(filterOption));
+
+    for (const Model &model : models()) {
+        const std::shared_ptr<CDecoder> &compiled = model.decoder;
+        CGenericDecoder generic(compiled->layout());
+        for (int count : pointCounts) {
+            const CScan in = scan(count);
+            const QByteArray raw = CDecoder::encode(compiled->layout(), in.angle(), in.range(), count);
+            CScan out;
+            bench.run("decode/" + model.name, count, [&]() {
+                compiled->decode(raw, out);
+                CBench::keep(out.range());
+            });
+            bench.run("decode-generic/" + model.name, count, [&]() {
+                generic.decode(raw, out);
+                CBench::keep(out.range());
+            });
+        }
+    }
+
+    for (int count : pointCounts) {
+        const CScan in = scan(count);
+        CCloudPoints cloud;
+        cloud.setLayout(count, 360.0f / count);
+        QVector<QPointF> points;
+        bench.run("store/cloudpoints", count, [&]() {
+            cloud.setScan(in);
+            cloud.getPoints(points);
+            CBench::keep(points.constData());
+        });
+    }
+
+    for (int count : pointCounts) {
+        CScan in = scan(count);
+        bench.run("polar/xy", count, [&]() {
+            in.range();
+            CBench::keep(static_cast<const CScan &>(in).x());
+        });
+    }
+
+    for (int count : pointCounts) {
+        const CScan in = scan(count);
+        CScan work;
+        CScanFilter filter;
+        bench.run("filter/scan", count, [&]() {
+            work = in;
+            filter.apply(work);
+            CBench::keep(work.range());
+        });
+    }
+
+    for (int count : pointCounts) {
+        const CScan in = scan(count);
+        CScanSegmenter segmenter;
+        CLineExtractor lineExtractor;
+        bench.run("segment/scan", count, [&]() {
+            CBench::keep(segmenter.segment(in).constData());
+        });
+        segmenter.segment(in);
+        bench.run("lines/extract", count, [&]() {
+            CBench::keep(lineExtractor.extract(segmenter).constData());
+        });
+    }
+
+    for (int count : pointCounts) {
+        CScan in = scan(count);
+        float *time = in.time();
+        for (int i = 0; i < count; i++)
+            time[i] = 0.1f * i / count;
+        const CPose2D motion(0.1, 0.02, qDegreesToRadians(3.0));
+        CDeskew deskew;
+        QVector<QPointF> out;
+        bench.run("deskew/scan", count, [&]() {
+            deskew.apply(in, motion, 0.1, out);
+            CBench::keep(out.constData());
+        });
+    }
+
+    for (int count : pointCounts) {
+        const QVector<QPointF> points = hits(scan(count));
+        COccupancyGrid grid;
+        bench.run("grid/integrate", count, [&]() {
+            grid.integrate(QPointF(0, 0), points.constData(), points.size());
+        });
+
+        const CPose2D guess(0.05, -0.05, qDegreesToRadians(1.0));
+        CScanMatcher matcher;
+        bench.run("match/scan", count, [&]() {
+            const CScanMatcher::Result result = matcher.match(grid, guess, points.constData(), points.size());
+            CBench::keep(&result);
+        });
+    }
+
+    CLumoMap map;
+    map.resize(1280, 720);
+    QImage image(map.size(), QImage::Format_ARGB32_Premultiplied);
+    for (int count : pointCounts) {
+        CCloudPoints cloud;
+        cloud.setLayout(count, 360.0f / count);
+        cloud.setScan(scan(count));
+        map.lumos(cloud);
+        bench.run("paint/lumomap", count, [&]() {
+            map.render(&image);
+            CBench::keep(image.constBits());
+        });
+    }
+
+    const QByteArray report = bench.report();
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            fprintf(stderr, "cannot write %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+        file.write(report);
+    }
+    else {
+        fwrite(report.constData(), 1, size_t(report.size()), stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+# Links a project against the static core library of core/LumoCore.pro.
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+QT += core network serialport
+
+LUMOCORE_DIR = $$shadowed($$PWD)
+win32 {
+    CONFIG(debug, debug|release): LUMOCORE_DIR = $$LUMOCORE_DIR/debug
+    else: LUMOCORE_DIR = $$LUMOCORE_DIR/release
+}
+LIBS += -L$$LUMOCORE_DIR -lLumoCore
+msvc: PRE_TARGETDEPS += $$LUMOCORE_DIR/LumoCore.lib
+else: PRE_TARGETDEPS += $$LUMOCORE_DIR/libLumoCore.a
@@ -0,0 +1,44 @@
+# Transports, decoders, scan storage and processing, without widgets.
+# Linked by the viewer, the daemon and the benchmarks via LumoCore.pri.
+TEMPLATE = lib
+CONFIG += staticlib c++11
+QT = core network serialport
+TARGET = LumoCore
+
+INCLUDEPATH += ..
+
+HEADERS += \
+    ../CComm.h \
+    ../CDecoder.h \
+    ../CDecoderRegistry.h \
+    ../CScan.h \
+    ../CScanArena.h \
+    ../CScanJob.h \
+    ../CJobPool.h \
+    ../CWorkPool.h \
+    ../CPipeline.h \
+    ../CIngest.h \
+    ../CCloudPoints.h \
+    ../COccupancyGrid.h \
+    ../CMapStore.h \
+    ../CPose2D.h \
+    ../CScanMatcher.h \
+    ../CScanSegmenter.h \
+    ../CLineExtractor.h \
+    ../CScanFilter.h \
+    ../CBackgroundModel.h \
+    ../CSafetyZones.h \
+    ../CDeskew.h \
+    ../CScanFusion.h \
+    ../CSensor.h \
+    ../CScanServer.h \
+    ../CMetrics.h \
+    ../CLatency.h \
+    ../CTrace.h \
+    ../CClock.h \
+    ../CSimd.h
+
+SOURCES += \
+           ../CComm.cpp \
+           ../CScanServer.cpp
+msvc: QMAKE_CXXFLAGS += /utf-8
@@ -0,0 +1,11 @@
+# Headless ingest daemon; needs no GUI modules.
+QT = core network serialport
+CONFIG += console c++11
+CONFIG -= app_bundle
+TARGET = LumoDaemon
+
+include(../core/LumoCore.pri)
+
+SOURCES += \
+           main.cpp
+msvc: QMAKE_CXXFLAGS += /utf-8
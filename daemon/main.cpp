@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <cstdio>
+
+#include "CComm.h"
+#include "CDecoderRegistry.h"
+#include "CIngest.h"
+#include "CMetrics.h"
+#include "CSafetyZones.h"
+#include "CScanServer.h"
+
+// Headless ingest: one sensor connection (or a synthetic source) through
+// the same decode -> filter -> transform -> publish pipeline as the viewer,
+// polled as fast as data arrives. Prints one CMetrics sample per interval
+// and a summary with stage latencies on exit, all as JSON lines on stdout.
+class CDaemon : public QObject {
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString type;               // tcp, udp or com
+        QString host;
+        int port = 0;
+        QString model;
+        int synthetic = 0;          // beams per generated scan; 0 reads the sensor
+        quint16 servePort = 0;
+        QString zones;
+        QString map;
+        QString metrics;
+    };
+
+    CDaemon(QObject *parent = nullptr)
+        : QObject(parent), server(new CScanServer(this)), zones(new CSafetyZones(this)),
+          ingest(new CIngest(server, zones, this))
+    {
+        QObject::connect(&pollTimer, &QTimer::timeout, this, &CDaemon::poll);
+        QObject::connect(&metrics, &CMetrics::sampled, this, [](const CMetrics::Sample &sample) {
+            const QByteArray line = CMetrics::toJson(sample);
+            fwrite(line.constData(), 1, size_t(line.size()), stdout);
+            fflush(stdout);
+        });
+        QObject::connect(zones, &CSafetyZones::onAlert, this, [](CSafetyZones *, int, const QString msg) {
+            fprintf(stderr, "%s\n", qPrintable(msg));
+        });
+    }
+    ~CDaemon() override {
+        ingest->close();
+        if (comm)
+            comm->close(commWaitFor);
+    }
+
+    bool start(const Options &options) {
+        std::shared_ptr<CDecoder> decoder = CDecoderRegistry::create(options.model);
+        if (!decoder)
+            return fail("Unknown sensor model " + options.model);
+        ingest->setDecoder(decoder);
+        metrics.addSource(ingest->metricsSource(0, options.model));
+
+        if (!options.map.isEmpty() && !ingest->openMap(options.map))
+            return fail("Cannot open map " + options.map);
+        if (!options.zones.isEmpty() && !zones->load(options.zones))
+            return fail("Cannot load zones " + options.zones);
+        if (options.servePort && !server->start(options.servePort))
+            return fail("Cannot serve on port " + QString::number(options.servePort));
+        if (!options.metrics.isEmpty() && !metrics.setExport(options.metrics))
+            return fail("Cannot export metrics to " + options.metrics);
+
+        if (options.synthetic > 0) {
+            synthetic = packet(decoder->layout(), options.synthetic);
+        }
+        else {
+            if (options.type == "udp")
+                comm = new UDPComm(this);
+            else if (options.type == "com")
+                comm = new SerialComm(this);
+            else
+                comm = new TCPComm(this);
+            QObject::connect(comm, &Comm::onAlert, this, [](Comm *, int, const QString msg) {
+                fprintf(stderr, "%s\n", qPrintable(msg));
+            });
+            QObject::connect(comm, &Comm::onStatus, this, [this](Comm *, Comm::eStatus status) {
+                if (status == Comm::eStatus::connected)
+                    ingest->reconnected();
+            });
+            if (!comm->setConnInfo(options.host, options.port))
+                return fail("Invalid connection " + options.host + " " + QString::number(options.port));
+            comm->setTimeout(true, connCheckInterval, true, false, false);
+            comm->setReconnect(true);
+            comm->connect(commWaitFor);
+        }
+        clock.start();
+        pollTimer.start(0);
+        return true;
+    }
+
+    // Totals and stage latencies since start.
+    QByteArray summary() {
+        const CMetricCounters &c = ingest->counters();
+        const double seconds = qMax<qint64>(clock.elapsed(), 1) / 1000.0;
+        QJsonObject latency;
+        for (const CLatency::SegmentStats &segment : ingest->latency().stats()) {
+            if (!segment.count)
+                continue;
+            QJsonObject s;
+            s["p50_ms"] = segment.p50Ms;
+            s["p99_ms"] = segment.p99Ms;
+            s["max_ms"] = segment.maxMs;
+            latency[segment.name] = s;
+        }
+        QJsonObject root;
+        root["summary"] = true;
+        root["seconds"] = seconds;
+        root["bytes"] = qint64(c.bytes.load());
+        root["scans"] = qint64(c.scans.load());
+        root["points"] = qint64(c.points.load());
+        root["partial_receives"] = qint64(c.partialReceives.load());
+        root["dropped"] = qint64(ingest->pipeline().dropped());
+        root["scans_per_s"] = c.scans.load() / seconds;
+        root["points_per_s"] = c.points.load() / seconds;
+        root["latency"] = latency;
+        return QJsonDocument(root).toJson(QJsonDocument::Compact) + '\n';
+    }
+
+private:
+    const int connCheckInterval = 200;
+    const quint32 commWaitFor = 1000;
+    const int maxInFlight = 4;      // synthetic: scans queued at once
+
+    CScanServer *server;
+    CSafetyZones *zones;
+    CIngest *ingest;
+    CMetrics metrics;
+    Comm *comm = nullptr;
+    QByteArray buff;
+    QByteArray synthetic;
+    QTimer pollTimer;
+    QElapsedTimer clock;
+
+    void poll() {
+        if (!synthetic.isEmpty()) {
+            if (ingest->pipeline().depth() >= maxInFlight)
+                return;
+            buff = synthetic;
+            ingest->push(buff, CClock::nsecs(), CClock::nsecs());
+            return;
+        }
+        if (!comm || !comm->isIdle() || !comm->inbox())
+            return;
+        if (comm->recv(buff, IGNORE))
+            ingest->push(buff, comm->arrivalStamp(), comm->recvStamp());
+    }
+
+    // One revolution of a room-like outline.
+    static QByteArray packet(const CDecoder::Layout &layout, int count) {
+        CScan scan;
+        scan.resize(count);
+        float *angle = scan.angle();
+        float *range = scan.range();
+        for (int i = 0; i < count; i++) {
+            angle[i] = layout.startAngle + 360.0f * i / count;
+            range[i] = 2500.0f + 800.0f * qSin(qDegreesToRadians(angle[i] * 3));
+        }
+        return CDecoder::encode(layout, angle, range, count);
+    }
+
+    static bool fail(const QString &msg) {
+        fprintf(stderr, "%s\n", qPrintable(msg));
+        return false;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("LumoDaemon");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless LiDAR ingest for edge boxes and soak tests");
+    parser.addHelpOption();
+    QCommandLineOption typeOption("type", "Transport: tcp, udp or com.", "type", "tcp");
+    QCommandLineOption hostOption("host", "Sensor address, or serial port name.", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Sensor port, or serial baud rate.", "port", "45454");
+    QCommandLineOption modelOption("model", "Sensor model: " + [] {
+        QStringList models;
+        for (const CDecoderRegistry::Entry &entry : CDecoderRegistry::entries())
+            models << entry.model;
+        return models.join(", ");
+    }() + ".", "model", CDecoderRegistry::defaultModel());
+    QCommandLineOption syntheticOption("synthetic", "No sensor: feed generated scans of <points> beams at max rate.", "points");
+    QCommandLineOption serveOption("serve", "Republish scans on TCP <port>.", "port");
+    QCommandLineOption zonesOption("zones", "Evaluate safety zones from <file>.", "file");
+    QCommandLineOption mapOption("map", "Page map tiles to <file>.", "file");
+    QCommandLineOption exportOption("metrics", "Also export metrics to <file> or local:<server name>.", "target");
+    QCommandLineOption durationOption("duration", "Exit after <seconds>; 0 runs until killed.", "seconds", "0");
+    QCommandLineOption traceOption("trace", "Record a Chrome trace and write it to <file> on exit.", "file");
+    parser.addOptions({typeOption, hostOption, portOption, modelOption, syntheticOption, serveOption,
+                       zonesOption, mapOption, exportOption, durationOption, traceOption});
+    parser.process(app);
+
+    CDaemon::Options options;
+    options.type = parser.value(typeOption).toLower();
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toInt();
+    options.model = parser.value(modelOption);
+    options.synthetic = parser.value(syntheticOption).toInt();
+    options.servePort = quint16(parser.value(serveOption).toUInt());
+    options.zones = parser.value(zonesOption);
+    options.map = parser.value(mapOption);
+    options.metrics = parser.value(exportOption);
+
+    CDaemon daemon;
+    if (!daemon.start(options))
+        return 1;
+    CTrace::setEnabled(parser.isSet(traceOption));
+
+    const int duration = parser.value(durationOption).toInt();
+    if (duration > 0)
+        QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+    const int ret = app.exec();
+
+    const QByteArray summary = daemon.summary();
+    fwrite(summary.constData(), 1, size_t(summary.size()), stdout);
+    if (parser.isSet(traceOption) && !CTrace::dump(parser.value(traceOption)))
+        fprintf(stderr, "Cannot write trace %s\n", qPrintable(parser.value(traceOption)));
+    return ret;
+}
+
+#include "main.moc"
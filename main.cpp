@@ -22,6 +22,7 @@
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+    QThread::currentThread()->setObjectName("Main");
     CMainWin mainWindow;
     mainWindow.show();
     return app.exec();
@@ -0,0 +1,10 @@
+# Heap allocations of the scan pipeline once it is warm; expects none.
+QT = core testlib
+CONFIG += console c++11 testcase
+CONFIG -= app_bundle
+TARGET = tst_alloc
+
+include(../../core/LumoCore.pri)
+
+SOURCES += \
+           tst_alloc.cpp
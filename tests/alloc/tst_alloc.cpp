@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <QtCore/QSemaphore>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+#include "CScanJob.h"
+#include "CPipeline.h"
+#include "CJobPool.h"
+#include "CDecoderRegistry.h"
+#include "CScanFilter.h"
+#include "CSafetyZones.h"
+#include "CScanSegmenter.h"
+#include "CLineExtractor.h"
+#include "CBackgroundModel.h"
+#include "CDeskew.h"
+#include "CScanMatcher.h"
+#include "COccupancyGrid.h"
+
+// Heap allocations of any thread while counting is on. Qt containers use
+// malloc directly, so on glibc malloc itself is wrapped; elsewhere only
+// operator new is seen.
+static std::atomic<bool> counting{false};
+static std::atomic<qint64> allocations{0};
+
+static inline void counted()
+{
+    if (counting.load(std::memory_order_relaxed))
+        allocations++;
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) __THROW
+{
+    counted();
+    return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size) __THROW
+{
+    counted();
+    return __libc_calloc(count, size);
+}
+void *realloc(void *p, size_t size) __THROW
+{
+    counted();
+    return __libc_realloc(p, size);
+}
+void free(void *p) __THROW
+{
+    __libc_free(p);
+}
+}
+#define NEW_COUNTED()
+#else
+#define NEW_COUNTED() counted()
+#endif
+
+void *operator new(size_t size)
+{
+    NEW_COUNTED();
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// The work-pool stages of CIngest, decode -> filter -> transform, fed one
+// scan at a time. Once the jobs, queues and per-stage buffers have seen a
+// scan, further scans must not touch the heap. The publish and deliver
+// stages post to the main thread through Qt's event queue, which allocates,
+// and are left out.
+class TestAlloc : public QObject {
+    Q_OBJECT
+
+private:
+    static const int warmUp = 100;
+    static const int measured = 1000;
+
+    QByteArray packet;
+    std::shared_ptr<CDecoder> decoder;
+    CScanFilter filter;
+    CSafetyZones zones;
+    CScanSegmenter segmenter;
+    CLineExtractor lineExtractor;
+    CBackgroundModel background;
+    CDeskew deskew;
+    QVector<QPointF> hits;
+    CScanMatcher matcher;
+    COccupancyGrid grid;
+    CPose2D pose;
+    QSemaphore done;
+    CJobPool<CScanJob> jobs;
+
+    // 1200 beams of a wavy room with a dropout every 17th beam.
+    void buildPacket() {
+        const CDecoder::Layout layout = decoder->layout();
+        QVector<float> angle(layout.beams), range(layout.beams);
+        for (int i = 0; i < layout.beams; i++) {
+            angle[i] = layout.startAngle + i * layout.resolution;
+            const double a = qDegreesToRadians(double(angle[i]));
+            range[i] = i % 17 ? float(2500.0 + 800.0 * std::sin(3.0 * a)) : 0.0f;
+        }
+        packet = CDecoder::encode(layout, angle.constData(), range.constData(), layout.beams);
+    }
+
+    void addStages(CPipeline<CScanJob> &pipeline) {
+        pipeline.addStage("decode", [](CScanJob &job) {
+            job.decoder->decode(job.raw, job.scan);
+            job.decoder->timeScan(job.scan, job.times.arrival);
+            return job.scan.size() > 0;
+        }, 2, CPipeline<CScanJob>::eThread::pool, CPipeline<CScanJob>::eFull::grow);
+        pipeline.addStage("filter", [this](CScanJob &job) {
+            filter.apply(job.scan);
+            zones.setBeams(job.decoder->layout().beams);
+            zones.evaluate(job.scan, job.times.arrival);
+            return true;
+        });
+        pipeline.addStage("transform", [this](CScanJob &job) {
+            const QVector<CScanSegmenter::Cluster> &clusters = segmenter.segment(job.scan);
+            job.clusters = job.arena.copy(clusters.constData(), clusters.size());
+            job.clusterCount = clusters.size();
+            const QVector<CLineExtractor::Segment> &segments = lineExtractor.extract(segmenter);
+            job.segments = job.arena.copy(segments.constData(), segments.size());
+            job.segmentCount = segments.size();
+
+            background.setBeams(job.decoder->layout().beams);
+            job.changed = background.update(job.scan);
+            job.changes = job.arena.alloc<QPointF>(job.changed);
+            const QVector<QPointF> &points = segmenter.points();
+            job.points = job.arena.alloc<QPointF>(points.size());
+            for (const QPointF &point : points) {
+                if (!qIsNaN(point.x()))
+                    job.points[job.pointCount++] = point;
+            }
+
+            const int count = deskew.apply(job.scan, CPose2D(), 0.1, hits);
+            if (grid.tileCount() > 0) {
+                CScanMatcher::Result match = matcher.match(grid, pose, hits.constData(), count);
+                if (match.matched)
+                    pose = match.pose;
+            }
+            for (int i = 0; i < count; i++)
+                hits[i] = pose.map(hits[i]);
+            QMutexLocker locker(grid.mutex());
+            grid.integrate(QPointF(pose.x, pose.y), hits.constData(), count);
+            job.pose = pose;
+            return true;
+        });
+        pipeline.addStage("done", [this](CScanJob &) {
+            done.release();
+            return true;
+        });
+    }
+
+    // As CIngest::push, with the bytes copied in the way a Comm recv fills
+    // a recycled buffer.
+    void push(CPipeline<CScanJob> &pipeline) {
+        CPipeline<CScanJob>::JobPtr job = jobs.acquire();
+        job->stamp = job->times.arrival = job->times.recv = CClock::nsecs();
+        job->raw.resize(packet.size());
+        memcpy(job->raw.data(), packet.constData(), size_t(packet.size()));
+        job->decoder = decoder;
+        pipeline.push(job);
+    }
+
+private slots:
+    void initTestCase() {
+        decoder = CDecoderRegistry::create(CDecoderRegistry::defaultModel());
+        QVERIFY(decoder);
+        buildPacket();
+
+        CSafetyZones::Zone zone;
+        zone.name = "Near";
+        zone.polygon = { QPointF(-1, -1), QPointF(1, -1), QPointF(1, 1), QPointF(-1, 1) };
+        zones.setZones({ zone });
+    }
+
+    void steadyScans() {
+        CPipeline<CScanJob> pipeline(this);
+        addStages(pipeline);
+
+        // A job is only free again once the last stage lets go of it, which
+        // may be just after the next scan is pushed.
+        {
+            QVector<CPipeline<CScanJob>::JobPtr> held;
+            for (int i = 0; i < 4; i++)
+                held.append(jobs.acquire());
+        }
+
+        for (int i = 0; i < warmUp; i++) {
+            push(pipeline);
+            done.acquire();
+        }
+        QVERIFY(grid.tileCount() > 0);
+
+        allocations = 0;
+        counting = true;
+        for (int i = 0; i < measured; i++) {
+            push(pipeline);
+            done.acquire();
+        }
+        counting = false;
+        pipeline.close();
+
+        QCOMPARE(allocations.load(), qint64(0));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestAlloc)
+
+#include "tst_alloc.moc"
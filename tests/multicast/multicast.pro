@@ -0,0 +1,10 @@
+# Two UDPComm multicast subscribers against loopback group traffic.
+QT = core network testlib
+CONFIG += console c++11 testcase
+CONFIG -= app_bundle
+TARGET = tst_multicast
+
+include(../../core/LumoCore.pri)
+
+SOURCES += \
+           tst_multicast.cpp
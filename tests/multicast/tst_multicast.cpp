@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <QtNetwork/QUdpSocket>
+
+#include "CComm.h"
+
+// Two UDPComm subscribers in one group on the loopback path: the kernel
+// loops the test's own group traffic back to both.
+class TestMulticast : public QObject {
+    Q_OBJECT
+
+private:
+    const QString group = "239.255.77.13";
+    quint16 port = 0;
+    UDPComm *a = nullptr, *b = nullptr;
+    QUdpSocket *sender = nullptr;
+
+    UDPComm *subscribe() {
+        UDPComm *comm = new UDPComm();
+        if (!comm->setConnInfo(group, port) || !comm->connect(0)) {
+            delete comm;
+            return nullptr;
+        }
+        return comm;
+    }
+
+    bool send(const QByteArray &datagram, const QHostAddress &to) {
+        return sender->writeDatagram(datagram, to, port) == datagram.size();
+    }
+
+    static QByteArray recvAll(UDPComm *comm) {
+        QByteArray buffer;
+        return comm->recv(buffer, IGNORE) ? buffer : QByteArray();
+    }
+
+private slots:
+    void init() {
+        port = quint16(QRandomGenerator::global()->bounded(40000, 60000));
+        a = subscribe();
+        b = subscribe();
+        if (!a || !b)
+            QSKIP("Cannot join a multicast group on this host");
+        QVERIFY(a->isMulticast() && b->isMulticast());
+        QTRY_VERIFY(a->isIdle() && b->isIdle());
+
+        sender = new QUdpSocket();
+        QVERIFY(sender->bind(QHostAddress::AnyIPv4, 0));
+        sender->setSocketOption(QAbstractSocket::MulticastLoopbackOption, 1);
+        sender->setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+    }
+
+    void cleanup() {
+        delete a;
+        delete b;
+        delete sender;
+        a = b = nullptr;
+        sender = nullptr;
+    }
+
+    void bothReceive() {
+        const QByteArray datagram("scan-1");
+        if (!send(datagram, QHostAddress(group)))
+            QSKIP("No multicast route on this host");
+        QTRY_VERIFY(a->inbox());
+        QTRY_VERIFY(b->inbox());
+        QCOMPARE(recvAll(a), datagram);
+        QCOMPARE(recvAll(b), datagram);
+    }
+
+    // Datagrams queued since the last recv() come out back to back.
+    void drainsAll() {
+        if (!send("one", QHostAddress(group)) || !send("two", QHostAddress(group)))
+            QSKIP("No multicast route on this host");
+        QByteArray got;
+        QTRY_COMPARE(got += recvAll(a), QByteArray("onetwo"));
+    }
+
+    // Leaving the group on one subscriber does not affect the other.
+    void leave() {
+        QVERIFY(!a->close(0));
+        if (!send("after", QHostAddress(group)))
+            QSKIP("No multicast route on this host");
+        QTRY_VERIFY(b->inbox());
+        QCOMPARE(recvAll(b), QByteArray("after"));
+    }
+
+    // Bound to the group address, subscribers do not see unicast sent to
+    // the same port.
+    void unicastIgnored() {
+#if defined(Q_OS_UNIX)
+        QVERIFY(send("unicast", QHostAddress::LocalHost));
+        if (!send("group", QHostAddress(group)))
+            QSKIP("No multicast route on this host");
+        QTRY_VERIFY(a->inbox());
+        QCOMPARE(recvAll(a), QByteArray("group"));
+#else
+        QSKIP("Subscribers bind the wildcard address on this platform");
+#endif
+    }
+};
+
+QTEST_GUILESS_MAIN(TestMulticast)
+
+#include "tst_multicast.moc"
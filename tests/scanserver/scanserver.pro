@@ -0,0 +1,10 @@
+# CScanServer compact and lines frame encode/decode round trips.
+QT = core network testlib
+CONFIG += console c++11 testcase
+CONFIG -= app_bundle
+TARGET = tst_scanserver
+
+include(../../core/LumoCore.pri)
+
+SOURCES += \
+           tst_scanserver.cpp
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <limits>
+
+#include "CScanServer.h"
+
+// encodeCompact/decodeCompact and encodeLines/decodeLines round trips, and
+// how the decoders treat frames that are cut short or lie about their size.
+class TestScanServer : public QObject {
+    Q_OBJECT
+
+private:
+    // Angles in 0.01 deg and ranges in whole mm survive exactly.
+    static QByteArray compact(const QVector<float> &angle, const QVector<float> &range, quint32 seq = 7) {
+        QByteArray frame;
+        CScanServer::encodeCompact(angle.constData(), range.constData(), angle.size(), seq, frame);
+        return frame;
+    }
+
+    static void setCount(QByteArray &frame, quint32 count) {
+        qToLittleEndian(count, reinterpret_cast<uchar *>(frame.data()) + 8);
+    }
+
+    static void setPayload(QByteArray &frame, quint32 payload) {
+        qToLittleEndian(payload, reinterpret_cast<uchar *>(frame.data()) + 12);
+    }
+
+private slots:
+    void compactRoundTrip() {
+        const QVector<float> angle = { 359.99f, 0.0f, 12.34f, 12.33f, 270.0f, 0.01f };
+        const QVector<float> range = { 30000.0f, 0.0f, 2500.0f, 2499.0f, -1.0f, 65535.0f };
+        const QByteArray frame = compact(angle, range, 42);
+
+        QVector<float> records;
+        quint32 seq = 0;
+        QCOMPARE(CScanServer::decodeCompact(frame.constData(), frame.size(), records, &seq), frame.size());
+        QCOMPARE(seq, quint32(42));
+        QCOMPARE(records.size(), angle.size() * 2);
+        for (int i = 0; i < angle.size(); i++) {
+            QCOMPARE(qRound(records[i * 2] * 100.0f), qRound(angle[i] * 100.0f));
+            QCOMPARE(records[i * 2 + 1], range[i]);
+        }
+    }
+
+    // Deltas from 0 to the largest range and back take five-byte varints
+    // in both directions.
+    void compactLargestVarints() {
+        const float top = 2147483520.0f;   // largest float below 2^31
+        const QVector<float> angle = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const QVector<float> range = { 0.0f, top, 0.0f, -top };
+        const QByteArray frame = compact(angle, range);
+        QCOMPARE(frame.size(), CScanServer::compactHeaderSize + 4 + 1 + 5 + 5 + 5);
+
+        QVector<float> records;
+        QCOMPARE(CScanServer::decodeCompact(frame.constData(), frame.size(), records), frame.size());
+        for (int i = 0; i < range.size(); i++)
+            QCOMPARE(records[i * 2 + 1], range[i]);
+    }
+
+    void compactEmpty() {
+        const QByteArray frame = compact({}, {});
+        QVector<float> records;
+        QCOMPARE(CScanServer::decodeCompact(frame.constData(), frame.size(), records), CScanServer::compactHeaderSize);
+        QVERIFY(records.isEmpty());
+    }
+
+    // Every prefix of a frame is incomplete, not invalid.
+    void compactTruncated() {
+        const QByteArray frame = compact({ 10.0f, 20.0f, 5.0f }, { 1000.0f, 200000.0f, 3.0f });
+        for (int size = 0; size < frame.size(); size++) {
+            QVector<float> records;
+            QCOMPARE(CScanServer::decodeCompact(frame.constData(), size, records), 0);
+        }
+    }
+
+    // Two frames back to back decode one at a time.
+    void compactStream() {
+        const QByteArray first = compact({ 1.0f }, { 100.0f }, 1);
+        const QByteArray second = compact({ 2.0f, 3.0f }, { 200.0f, 300.0f }, 2);
+        const QByteArray stream = first + second;
+        QVector<float> records;
+        quint32 seq = 0;
+        const int used = CScanServer::decodeCompact(stream.constData(), stream.size(), records, &seq);
+        QCOMPARE(used, first.size());
+        QCOMPARE(seq, quint32(1));
+        QCOMPARE(CScanServer::decodeCompact(stream.constData() + used, stream.size() - used, records, &seq), second.size());
+        QCOMPARE(seq, quint32(2));
+        QCOMPARE(records, QVector<float>({ 1.0f, 100.0f, 2.0f, 200.0f, 3.0f, 300.0f }));
+    }
+
+    void compactInvalid() {
+        const QByteArray frame = compact({ 10.0f, 20.0f }, { 1000.0f, 2000.0f });
+        QVector<float> records;
+
+        QByteArray magic = frame;
+        magic[1] = 'X';
+        QCOMPARE(CScanServer::decodeCompact(magic.constData(), magic.size(), records), -1);
+
+        // More points than the payload can hold.
+        QByteArray count = frame;
+        setCount(count, std::numeric_limits<quint32>::max());
+        QCOMPARE(CScanServer::decodeCompact(count.constData(), count.size(), records), -1);
+
+        QByteArray huge = frame;
+        setPayload(huge, CScanServer::maxFramePayload + 1);
+        QCOMPARE(CScanServer::decodeCompact(huge.constData(), huge.size(), records), -1);
+
+        // A plausible count, but the second point's varints run past the
+        // payload (each point takes four bytes here).
+        QByteArray cut = frame;
+        setPayload(cut, 4);
+        QCOMPARE(CScanServer::decodeCompact(cut.constData(), cut.size(), records), -1);
+    }
+
+    void linesRoundTrip() {
+        QVector<CLineExtractor::Segment> in(3);
+        in[0].a = QPointF(1.5, -2.25);
+        in[0].b = QPointF(-3.0, 4.125);
+        in[0].maxError = 0.0123f;
+        in[1].a = QPointF(-1073741.0, 1073741.0);     // b - a near the largest mm delta
+        in[1].b = QPointF(1073741.0, -1073741.0);
+        in[2].a = QPointF(0.0, 0.0);
+        in[2].b = QPointF(0.001, -0.001);
+        QByteArray frame;
+        CScanServer::encodeLines(in.constData(), in.size(), 9, frame);
+
+        QVector<CLineExtractor::Segment> out;
+        quint32 seq = 0;
+        QCOMPARE(CScanServer::decodeLines(frame.constData(), frame.size(), out, &seq), frame.size());
+        QCOMPARE(seq, quint32(9));
+        QCOMPARE(out.size(), in.size());
+        for (int i = 0; i < in.size(); i++) {
+            QCOMPARE(qRound64(out[i].a.x() * 1000), qRound64(in[i].a.x() * 1000));
+            QCOMPARE(qRound64(out[i].a.y() * 1000), qRound64(in[i].a.y() * 1000));
+            QCOMPARE(qRound64(out[i].b.x() * 1000), qRound64(in[i].b.x() * 1000));
+            QCOMPARE(qRound64(out[i].b.y() * 1000), qRound64(in[i].b.y() * 1000));
+            QCOMPARE(qRound(out[i].maxError * 10000), qRound(in[i].maxError * 10000));
+        }
+    }
+
+    void linesTruncatedAndInvalid() {
+        QVector<CLineExtractor::Segment> in(2);
+        in[0].b = QPointF(1.0, 1.0);
+        in[1].a = QPointF(-5.0, 2.0);
+        in[1].b = QPointF(-6.0, 3.0);
+        QByteArray frame;
+        CScanServer::encodeLines(in.constData(), in.size(), 1, frame);
+
+        QVector<CLineExtractor::Segment> out;
+        for (int size = 0; size < frame.size(); size++)
+            QCOMPARE(CScanServer::decodeLines(frame.constData(), size, out), 0);
+
+        QByteArray count = frame;
+        setCount(count, quint32(frame.size()));
+        QCOMPARE(CScanServer::decodeLines(count.constData(), count.size(), out), -1);
+
+        // The first segment takes seven bytes, the second runs past ten.
+        QByteArray cut = frame;
+        setPayload(cut, 10);
+        QCOMPARE(CScanServer::decodeLines(cut.constData(), cut.size(), out), -1);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestScanServer)
+
+#include "tst_scanserver.moc"
@@ -0,0 +1,12 @@
+# SerialComm framing, checksum and resync against a pseudo-terminal pair.
+QT = core testlib serialport
+CONFIG += console c++11 testcase
+CONFIG -= app_bundle
+TARGET = tst_serialcomm
+
+include(../../core/LumoCore.pri)
+
+linux: LIBS += -lutil
+
+SOURCES += \
+           tst_serialcomm.cpp
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is part of LumosLiDARViewer.
+ *
+ * LumosLiDARViewer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * LumosLiDARViewer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LumosLiDARViewer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(Q_OS_MACOS)
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+#include "CComm.h"
+
+// SerialComm on the slave end of a pseudo-terminal; the test writes wire
+// bytes into the master end.
+class TestSerialComm : public QObject {
+    Q_OBJECT
+
+private:
+    int master = -1, slave = -1;
+    SerialComm *comm = nullptr;
+
+    static QByteArray framed(const QByteArray &payload) {
+        QByteArray out;
+        SerialComm::frame(payload, out);
+        return out;
+    }
+
+    static QByteArray payload(int size, char seed) {
+        QByteArray out(size, Qt::Uninitialized);
+        for (int i = 0; i < size; i++)
+            out[i] = char(seed + i * 7);
+        return out;
+    }
+
+    // The master is non-blocking; the event loop keeps the slave drained
+    // while a large write is pending.
+    void write(const QByteArray &bytes) {
+        int done = 0;
+        while (done < bytes.size()) {
+            const ssize_t n = ::write(master, bytes.constData() + done, size_t(bytes.size() - done));
+            if (n > 0)
+                done += int(n);
+            else if (n < 0 && errno != EAGAIN && errno != EINTR)
+                QFAIL(qPrintable(QString("write: %1").arg(strerror(errno))));
+            else
+                QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        }
+    }
+
+    QByteArray recvAll() {
+        QByteArray buffer;
+        return comm->recv(buffer, IGNORE) ? buffer : QByteArray();
+    }
+
+private slots:
+    void init() {
+        char name[128];
+        QVERIFY(::openpty(&master, &slave, name, nullptr, nullptr) == 0);
+        QVERIFY(::fcntl(master, F_SETFL, ::fcntl(master, F_GETFL) | O_NONBLOCK) == 0);
+        comm = new SerialComm();
+        QVERIFY(comm->setConnInfo(QString::fromLocal8Bit(name), 3000000));
+        QVERIFY(comm->connect(1000));
+        QTRY_VERIFY(comm->isIdle());
+    }
+
+    void cleanup() {
+        comm->close(0);
+        delete comm;
+        comm = nullptr;
+        ::close(slave);
+        ::close(master);
+    }
+
+    void framing() {
+        const QByteArray a = payload(8 * 40, 1), b = payload(8 * 3, 2);
+        write(framed(a) + framed(b));
+        QTRY_COMPARE(comm->framesRecved(), 2u);
+        QVERIFY(comm->inbox());
+        QCOMPARE(recvAll(), a + b);
+        QCOMPARE(comm->framesDropped(), 0u);
+        QCOMPARE(comm->bytesDiscarded(), 0u);
+    }
+
+    // A frame arriving a byte at a time is only handed out once complete.
+    void splitFrame() {
+        const QByteArray a = framed(payload(8 * 10, 3));
+        for (int i = 0; i < a.size(); i++) {
+            write(a.mid(i, 1));
+            QCoreApplication::processEvents();
+            if (i + 1 < a.size())
+                QCOMPARE(comm->framesRecved(), 0u);
+        }
+        QTRY_COMPARE(comm->framesRecved(), 1u);
+        QCOMPARE(recvAll(), a.mid(SerialComm::headerSize, a.size() - SerialComm::headerSize - SerialComm::trailerSize));
+    }
+
+    void badChecksum() {
+        const QByteArray a = payload(8 * 5, 4), b = payload(8 * 6, 5);
+        QByteArray corrupt = framed(a);
+        corrupt[SerialComm::headerSize + 3] = char(corrupt[SerialComm::headerSize + 3] ^ 0x10);
+        write(corrupt + framed(b));
+        QTRY_COMPARE(comm->framesRecved(), 1u);
+        QCOMPARE(recvAll(), b);
+        QVERIFY(comm->framesDropped() >= 1);
+    }
+
+    // Garbage, a stray sync byte and an oversized length field in front of
+    // a valid frame are skipped.
+    void resync() {
+        const QByteArray a = payload(8 * 7, 6);
+        QByteArray garbage("noise\xA5\x00\xA5\x5A\xFF\xFF", 11);
+        write(garbage + framed(a));
+        QTRY_COMPARE(comm->framesRecved(), 1u);
+        QCOMPARE(recvAll(), a);
+        QVERIFY(comm->bytesDiscarded() >= 5);
+    }
+
+    // With nobody reading, whole frames past the inbox capacity are dropped
+    // and what is kept still starts and ends on a frame boundary.
+    void inboxBound() {
+        const QByteArray a = payload(SerialComm::maxPayload, 7);
+        const int frames = SerialComm::inboxCapacity / a.size() + 4;
+        for (int i = 0; i < frames; i++)
+            write(framed(a));
+        QTRY_COMPARE(comm->framesRecved() + comm->framesOverflowed(), quint32(frames));
+        QVERIFY(comm->framesOverflowed() > 0);
+        const QByteArray got = recvAll();
+        QVERIFY(got.size() <= SerialComm::inboxCapacity);
+        QCOMPARE(got.size() % a.size(), 0);
+        QCOMPARE(got.left(a.size()), a);
+
+        write(framed(a));
+        QTRY_VERIFY(comm->inbox());
+        QCOMPARE(recvAll(), a);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSerialComm)
+
+#include "tst_serialcomm.moc"
@@ -0,0 +1,6 @@
+# Transport and pipeline tests; "make check" from the build directory runs
+# them all.
+TEMPLATE = subdirs
+
+SUBDIRS += multicast alloc scanserver
+unix: SUBDIRS += serialcomm